@@ -124,8 +124,129 @@ typedef struct
     
     /* List of reference elements: */
     pmh_realelement *references;
+    
+    /* Arena to allocate result elements from (NULL to use malloc): */
+    pmh_arena *arena;
 } parser_data;
 
+
+
+/* Size of one regular arena chunk: */
+#define pmh_ARENA_CHUNK_SIZE (64 * 1024)
+
+/* Alignment of allocations from an arena: */
+#define pmh_ARENA_ALIGN 16
+#define pmh_ARENA_ALIGN_UP(x) (((x) + pmh_ARENA_ALIGN - 1) \
+                               & ~((size_t)pmh_ARENA_ALIGN - 1))
+
+typedef struct pmh_ArenaChunk
+{
+    struct pmh_ArenaChunk *next;
+    
+    /* Capacity and used bytes of the data following this header: */
+    size_t size;
+    size_t used;
+} pmh_arena_chunk;
+
+#define pmh_ARENA_CHUNK_DATA(c) ((char *)(c) \
+                                 + pmh_ARENA_ALIGN_UP(sizeof(pmh_arena_chunk)))
+
+struct pmh_Arena
+{
+    /* All the chunks. Chunks after current are kept for reuse: */
+    pmh_arena_chunk *head;
+    pmh_arena_chunk *current;
+};
+
+pmh_arena *pmh_arena_new(void)
+{
+    pmh_arena *arena = (pmh_arena *)malloc(sizeof(pmh_arena));
+    arena->head = NULL;
+    arena->current = NULL;
+    return arena;
+}
+
+void pmh_arena_reset(pmh_arena *arena)
+{
+    /* Chunks after head are reset lazily when the allocation reaches them: */
+    arena->current = arena->head;
+    if (arena->head != NULL)
+        arena->head->used = 0;
+}
+
+void pmh_arena_free(pmh_arena *arena)
+{
+    pmh_arena_chunk *chunk = arena->head;
+    while (chunk != NULL) {
+        pmh_arena_chunk *tofree = chunk;
+        chunk = chunk->next;
+        free(tofree);
+    }
+    free(arena);
+}
+
+static void *arena_alloc(pmh_arena *arena, size_t size)
+{
+    size = pmh_ARENA_ALIGN_UP(size);
+    
+    pmh_arena_chunk *chunk = arena->current;
+    while (chunk != NULL && chunk->used + size > chunk->size)
+    {
+        if (chunk->next == NULL)
+            break;
+        chunk = chunk->next;
+        chunk->used = 0;
+    }
+    
+    if (chunk == NULL || chunk->used + size > chunk->size)
+    {
+        size_t data_size = (size > pmh_ARENA_CHUNK_SIZE)
+                           ? size : pmh_ARENA_CHUNK_SIZE;
+        pmh_arena_chunk *new_chunk = (pmh_arena_chunk *)
+            malloc(pmh_ARENA_ALIGN_UP(sizeof(pmh_arena_chunk)) + data_size);
+        new_chunk->next = NULL;
+        new_chunk->size = data_size;
+        new_chunk->used = 0;
+        if (chunk == NULL)
+            arena->head = new_chunk;
+        else
+            chunk->next = new_chunk;
+        chunk = new_chunk;
+    }
+    
+    arena->current = chunk;
+    void *ret = pmh_ARENA_CHUNK_DATA(chunk) + chunk->used;
+    chunk->used += size;
+    return ret;
+}
+
+/* Allocate memory for results (from the arena, if any): */
+static void *result_alloc(parser_data *p_data, size_t size)
+{
+    if (p_data->arena != NULL)
+        return arena_alloc(p_data->arena, size);
+    return malloc(size);
+}
+
+/* Free memory allocated by result_alloc(): */
+static void result_free(parser_data *p_data, void *ptr)
+{
+    if (p_data->arena == NULL)
+        free(ptr);
+}
+
+static char *result_strdup_or_null(parser_data *p_data, char *s)
+{
+    if (s == NULL)
+        return NULL;
+    if (p_data->arena == NULL)
+        return strdup(s);
+    size_t len = strlen(s) + 1;
+    char *ret = (char *)arena_alloc(p_data->arena, len);
+    memcpy(ret, s, len);
+    return ret;
+}
+
 static parser_data *mk_parser_data(char *original_input,
                                    unsigned long *strip_positions,
                                    size_t strip_positions_len,
@@ -134,9 +255,11 @@ static parser_data *mk_parser_data(char *original_input,
                                    unsigned long offset,
                                    int extensions,
                                    pmh_realelement **head_elems,
-                                   pmh_realelement *references)
+                                   pmh_realelement *references,
+                                   pmh_arena *arena)
 {
     parser_data *p_data = (parser_data *)malloc(sizeof(parser_data));
+    p_data->arena = arena;
     p_data->extensions = extensions;
     p_data->original_input = original_input;
     p_data->strip_positions = strip_positions;
@@ -150,7 +273,8 @@ static parser_data *mk_parser_data(char *original_input,
         p_data->head_elems = head_elems;
     else {
         p_data->head_elems = (pmh_realelement **)
-                             malloc(sizeof(pmh_realelement *) * pmh_NUM_TYPES);
+                             result_alloc(p_data,
+                                          sizeof(pmh_realelement *) * pmh_NUM_TYPES);
         int i;
         for (i = 0; i < pmh_NUM_TYPES; i++)
             p_data->head_elems[i] = NULL;
@@ -369,7 +493,8 @@ static void process_raw_blocks(parser_data *p_data)
                     subspan_list->pos,
                     p_data->extensions,
                     p_data->head_elems,
-                    p_data->references
+                    p_data->references,
+                    p_data->arena
                 );
                 parse_markdown(raw_p_data);
                 free(raw_p_data);
@@ -497,8 +622,9 @@ static int strcpy_preformat(char *str, char **out,
 
 
 
-void pmh_markdown_to_elements(char *text, int extensions,
-                              pmh_element **out_result[])
+static void markdown_to_elements(char *text, int extensions,
+                                 pmh_arena *arena,
+                                 pmh_element **out_result[])
 {
     char *text_copy = NULL;
     unsigned long *strip_positions = NULL;
@@ -522,7 +648,8 @@ void pmh_markdown_to_elements(char *text, int extensions,
         0,
         extensions,
         NULL,
-        NULL
+        NULL,
+        arena
     );
     pmh_realelement **result = p_data->head_elems;
     
@@ -553,6 +680,20 @@ void pmh_markdown_to_elements(char *text, int extensions,
     *out_result = (pmh_element**)result;
 }
 
+void pmh_markdown_to_elements(char *text, int extensions,
+                              pmh_element **out_result[])
+{
+    markdown_to_elements(text, extensions, NULL, out_result);
+}
+
+void pmh_markdown_to_elements_in_arena(char *text, int extensions,
+                                       pmh_arena *arena,
+                                       pmh_element **out_result[])
+{
+    assert(arena != NULL);
+    markdown_to_elements(text, extensions, arena, out_result);
+}
+
 
 
 /*
@@ -711,7 +852,8 @@ static pmh_realelement *reverse(pmh_realelement *list)
 static pmh_realelement *mk_element(parser_data *p_data, pmh_element_type type,
                                    long pos, long end)
 {
-    pmh_realelement *result = (pmh_realelement *)malloc(sizeof(pmh_realelement));
+    pmh_realelement *result = (pmh_realelement *)
+                              result_alloc(p_data, sizeof(pmh_realelement));
     memset(result, 0, sizeof(*result));
     result->type = type;
     result->pos = pos;
@@ -729,9 +871,9 @@ static pmh_realelement *mk_element(parser_data *p_data, pmh_element_type type,
 static pmh_realelement *copy_element(parser_data *p_data, pmh_realelement *elem)
 {
     pmh_realelement *result = mk_element(p_data, elem->type, elem->pos, elem->end);
-    result->label = strdup_or_null(elem->label);
-    result->text = strdup_or_null(elem->text);
-    result->address = strdup_or_null(elem->address);
+    result->label = result_strdup_or_null(p_data, elem->label);
+    result->text = result_strdup_or_null(p_data, elem->text);
+    result->address = result_strdup_or_null(p_data, elem->address);
     return result;
 }
 
@@ -741,7 +883,7 @@ static pmh_realelement *mk_etext(parser_data *p_data, char *string)
     pmh_realelement *result;
     assert(string != NULL);
     result = mk_element(p_data, pmh_EXTRA_TEXT, 0,0);
-    result->text = strdup_or_null(string);
+    result->text = result_strdup_or_null(p_data, string);
     return result;
 }
 
@@ -922,7 +1064,7 @@ static char *copy_input_span(parser_data *p_data,
         
         // Copy span from original input:
         size_t adjusted_len = adjusted_end - adjusted_pos;
-        char *str = (char *)malloc(sizeof(char)*adjusted_len + 1);
+        char *str = (char *)result_alloc(p_data, sizeof(char)*adjusted_len + 1);
         *str = '\0';
         strncat(str, (p_data->original_input + adjusted_pos), adjusted_len);
         
@@ -931,13 +1073,13 @@ static char *copy_input_span(parser_data *p_data,
         else
         {
             // append str to ret:
-            char *new_ret = (char *)malloc(sizeof(char)
+            char *new_ret = (char *)result_alloc(p_data, sizeof(char)
                                            *(strlen(str) + strlen(ret)) + 1);
             *new_ret = '\0';
             strcat(new_ret, ret);
             strcat(new_ret, str);
-            free(ret);
-            free(str);
+            result_free(p_data, ret);
+            result_free(p_data, str);
             ret = new_ret;
         }
         
@@ -1020,8 +1162,9 @@ static void yy_input_func(char *buf, int *result, int max_size,
 #define REF_EXISTS(x) reference_exists((parser_data *)G->data, x)
 #define GET_REF(x)  get_reference((parser_data *)G->data, x)
 #define PARSING_REFERENCES ((parser_data *)G->data)->parsing_only_references
-#define FREE_LABEL(l) { free(l->label); l->label = NULL; }
-#define FREE_ADDRESS(l) { free(l->address); l->address = NULL; }
+#define STRDUP(x)   result_strdup_or_null((parser_data *)G->data, x)
+#define FREE_LABEL(l) { result_free((parser_data *)G->data, l->label); l->label = NULL; }
+#define FREE_ADDRESS(l) { result_free((parser_data *)G->data, l->address); l->address = NULL; }
 
 // This gives us the text matched with < > as it appears in the original input:
 #define COPY_YYTEXT_ORIG() copy_input_span((parser_data *)G->data, thunk->begin, thunk->end)
@@ -1582,8 +1725,8 @@ YY_ACTION(void) yy_1_Reference(GREG *G, char *yytext, int yyleng, yythunk *thunk
   yyprintf((stderr, "do yy_1_Reference\n"));
   
                 pmh_realelement *el = elem_s(pmh_REFERENCE);
-                el->label = strdup_or_null(l->label);
-                el->address = strdup_or_null(r->address);
+                el->label = STRDUP(l->label);
+                el->address = STRDUP(r->address);
                 ADD(el);
                 FREE_LABEL(l);
                 FREE_ADDRESS(r);
@@ -1663,7 +1806,7 @@ YY_ACTION(void) yy_1_ExplicitLink(GREG *G, char *yytext, int yyleng, yythunk *th
   
                     yy = elem_s(pmh_LINK);
                     if (l->address != NULL)
-                        yy->address = strdup_or_null(l->address);
+                        yy->address = STRDUP(l->address);
                     FREE_LABEL(s);
                     FREE_ADDRESS(l);
                 ;
@@ -1678,8 +1821,8 @@ YY_ACTION(void) yy_1_ReferenceLinkSingle(GREG *G, char *yytext, int yyleng, yyth
                         	pmh_realelement *reference = GET_REF(s->label);
                             if (reference) {
                                 yy = elem_s(pmh_LINK);
-                                yy->label = strdup_or_null(s->label);
-                                yy->address = strdup_or_null(reference->address);
+                                yy->label = STRDUP(s->label);
+                                yy->address = STRDUP(reference->address);
                             } else
                                 yy = NULL;
                             FREE_LABEL(s);
@@ -1695,8 +1838,8 @@ YY_ACTION(void) yy_1_ReferenceLinkDouble(GREG *G, char *yytext, int yyleng, yyth
                         	pmh_realelement *reference = GET_REF(l->label);
                             if (reference) {
                                 yy = elem_s(pmh_LINK);
-                                yy->label = strdup_or_null(l->label);
-                                yy->address = strdup_or_null(reference->address);
+                                yy->label = STRDUP(l->label);
+                                yy->address = STRDUP(reference->address);
                             } else
                                 yy = NULL;
                             FREE_LABEL(s);
@@ -41,6 +41,63 @@
 void pmh_markdown_to_elements(char *text, int extensions,
                               pmh_element **out_result[]);
 
+/**
+* \brief Memory arena for parsing results
+* 
+* A bump allocator which could be reused across parses. All the elements
+* (and their strings) of a parsing result are allocated from the arena and
+* released at once by pmh_arena_reset(), after which the memory is reused
+* by the next parse.
+* 
+* \sa pmh_markdown_to_elements_in_arena
+*/
+typedef struct pmh_Arena pmh_arena;
+
+/**
+* \brief Create an empty arena
+* 
+* \return A new arena. You must pass it to pmh_arena_free() when it's not
+*         needed anymore.
+*/
+pmh_arena *pmh_arena_new(void);
+
+/**
+* \brief Release all the results allocated from an arena
+* 
+* Results parsed into the arena become invalid. The memory of the arena
+* is kept for reuse.
+* 
+* \param[in]  arena  The arena to reset.
+*/
+void pmh_arena_reset(pmh_arena *arena);
+
+/**
+* \brief Free an arena and all its memory
+* 
+* \param[in]  arena  The arena created by pmh_arena_new().
+*/
+void pmh_arena_free(pmh_arena *arena);
+
+/**
+* \brief Parse Markdown text into an arena, return elements
+* 
+* Same as pmh_markdown_to_elements(), except that the results are allocated
+* from the given arena. Do NOT pass the results to pmh_free_elements(); call
+* pmh_arena_reset() on the arena instead.
+* 
+* \param[in]  text        The Markdown text to parse for highlighting.
+* \param[in]  extensions  The extensions to use in parsing (a bitfield
+*                         of pmh_extensions values).
+* \param[in]  arena       The arena to allocate the results from.
+* \param[out] out_result  A pmh_element array, indexed by type, containing
+*                         the results of the parsing (linked lists of elements).
+* 
+* \sa pmh_arena_reset
+*/
+void pmh_markdown_to_elements_in_arena(char *text, int extensions,
+                                       pmh_arena *arena,
+                                       pmh_element **out_result[]);
+
 /**
 * \brief Sort elements in list by start offset.
 * 
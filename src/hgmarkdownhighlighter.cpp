@@ -6,24 +6,10 @@
 #include "vconfigmanager.h"
 #include "utils/vutils.h"
 #include "vtextblockdata.h"
+#include "vpegparser.h"
 
 extern VConfigManager *g_config;
 
-const int HGMarkdownHighlighter::initCapacity = 1024;
-
-void HGMarkdownHighlighter::resizeBuffer(int newCap)
-{
-    if (newCap == capacity) {
-        return;
-    }
-    if (capacity > 0) {
-        Q_ASSERT(content);
-        delete [] content;
-    }
-    capacity = newCap;
-    content = new char [capacity];
-}
-
 // Will be freeed by parent automatically
 HGMarkdownHighlighter::HGMarkdownHighlighter(const QVector<HighlightingStyle> &styles,
                                              const QHash<QString, QTextCharFormat> &codeBlockStyles,
@@ -33,12 +19,18 @@ HGMarkdownHighlighter::HGMarkdownHighlighter(const QVector<HighlightingStyle> &s
       highlightingStyles(styles),
       m_codeBlockStyles(codeBlockStyles),
       m_numOfCodeBlockHighlightsToRecv(0),
-      parsing(0),
       m_blockHLResultReady(false),
       waitInterval(waitInterval),
-      content(NULL),
-      capacity(0),
-      result(NULL)
+      m_dirtyStart(-1),
+      m_dirtyEnd(-1),
+      m_parsedCharCount(0),
+      m_parsedBlockCount(0),
+      m_hasReferences(false),
+      m_incrementalParseReady(false),
+      m_parseTimeStamp(0),
+      m_firstVisibleBlock(-1),
+      m_lastVisibleBlock(-1),
+      m_nextIdleBlock(0)
 {
     codeBlockStartExp = QRegExp(VUtils::c_fencedCodeBlockStartRegExp);
     codeBlockEndExp = QRegExp(VUtils::c_fencedCodeBlockEndRegExp);
@@ -59,9 +51,12 @@ HGMarkdownHighlighter::HGMarkdownHighlighter(const QVector<HighlightingStyle> &s
     m_colorColumnFormat.setForeground(QColor(g_config->getEditorColorColumnFg()));
     m_colorColumnFormat.setBackground(QColor(g_config->getEditorColorColumnBg()));
 
-    resizeBuffer(initCapacity);
     document = parent;
 
+    m_parser = new VPegParser(this);
+    connect(m_parser, &VPegParser::parseResultReady,
+            this, &HGMarkdownHighlighter::handleParseResult);
+
     timer = new QTimer(this);
     timer->setSingleShot(true);
     timer->setInterval(this->waitInterval);
@@ -70,6 +65,12 @@ HGMarkdownHighlighter::HGMarkdownHighlighter(const QVector<HighlightingStyle> &s
                 startParseAndHighlight(false);
             });
 
+    m_idleRehighlightTimer = new QTimer(this);
+    m_idleRehighlightTimer->setSingleShot(true);
+    m_idleRehighlightTimer->setInterval(0);
+    connect(m_idleRehighlightTimer, &QTimer::timeout,
+            this, &HGMarkdownHighlighter::rehighlightInIdleTime);
+
     static const int completeWaitTime = 500;
     m_completeTimer = new QTimer(this);
     m_completeTimer->setSingleShot(true);
@@ -83,15 +84,6 @@ HGMarkdownHighlighter::HGMarkdownHighlighter(const QVector<HighlightingStyle> &s
 
 HGMarkdownHighlighter::~HGMarkdownHighlighter()
 {
-    if (result) {
-        pmh_free_elements(result);
-        result = NULL;
-    }
-    if (content) {
-        delete [] content;
-        capacity = 0;
-        content = NULL;
-    }
 }
 
 void HGMarkdownHighlighter::updateBlockUserData(int p_blockNum, const QString &p_text)
@@ -184,197 +176,6 @@ exit:
     highlightChanged();
 }
 
-void HGMarkdownHighlighter::initBlockHighlightFromResult(int nrBlocks)
-{
-    blockHighlights.resize(nrBlocks);
-    for (int i = 0; i < blockHighlights.size(); ++i) {
-        blockHighlights[i].clear();
-    }
-
-    if (!result) {
-        return;
-    }
-
-    for (int i = 0; i < highlightingStyles.size(); i++)
-    {
-        const HighlightingStyle &style = highlightingStyles[i];
-        pmh_element *elem_cursor = result[style.type];
-
-        // pmh_H1 to pmh_H6 is continuous.
-        bool isHeader = style.type >= pmh_H1 && style.type <= pmh_H6;
-
-        while (elem_cursor != NULL)
-        {
-            // elem_cursor->pos and elem_cursor->end is the start
-            // and end position of the element in document.
-            if (elem_cursor->end <= elem_cursor->pos) {
-                elem_cursor = elem_cursor->next;
-                continue;
-            }
-
-            // Check header. Skip those headers with no spaces after #s.
-            if (isHeader
-                && !isValidHeader(elem_cursor->pos, elem_cursor->end)) {
-                elem_cursor = elem_cursor->next;
-                continue;
-            }
-
-            initBlockHighlihgtOne(elem_cursor->pos, elem_cursor->end, i);
-            elem_cursor = elem_cursor->next;
-        }
-    }
-}
-
-void HGMarkdownHighlighter::initHtmlCommentRegionsFromResult()
-{
-    // From Qt5.7, the capacity is preserved.
-    m_commentRegions.clear();
-
-    if (!result) {
-        return;
-    }
-
-    pmh_element *elem = result[pmh_COMMENT];
-    while (elem != NULL) {
-        if (elem->end <= elem->pos) {
-            elem = elem->next;
-            continue;
-        }
-
-        m_commentRegions.push_back(VElementRegion(elem->pos, elem->end));
-
-        elem = elem->next;
-    }
-
-    qDebug() << "highlighter: parse" << m_commentRegions.size() << "HTML comment regions";
-}
-
-void HGMarkdownHighlighter::initImageRegionsFromResult()
-{
-    if (!result) {
-        // From Qt5.7, the capacity is preserved.
-        m_imageRegions.clear();
-        emit imageLinksUpdated(m_imageRegions);
-        return;
-    }
-
-    int idx = 0;
-    int oriSize = m_imageRegions.size();
-    pmh_element *elem = result[pmh_IMAGE];
-    while (elem != NULL) {
-        if (elem->end <= elem->pos) {
-            elem = elem->next;
-            continue;
-        }
-
-        if (idx < oriSize) {
-            // Try to reuse the original element.
-            VElementRegion &reg = m_imageRegions[idx];
-            if ((int)elem->pos != reg.m_startPos || (int)elem->end != reg.m_endPos) {
-                reg.m_startPos = (int)elem->pos;
-                reg.m_endPos = (int)elem->end;
-            }
-        } else {
-            m_imageRegions.push_back(VElementRegion(elem->pos, elem->end));
-        }
-
-        ++idx;
-        elem = elem->next;
-    }
-
-    if (idx < oriSize) {
-        m_imageRegions.resize(idx);
-    }
-
-    qDebug() << "highlighter: parse" << m_imageRegions.size() << "image regions";
-
-    emit imageLinksUpdated(m_imageRegions);
-}
-
-void HGMarkdownHighlighter::initHeaderRegionsFromResult()
-{
-    if (!result) {
-        // From Qt5.7, the capacity is preserved.
-        m_headerRegions.clear();
-        emit headersUpdated(m_headerRegions);
-        return;
-    }
-
-    int idx = 0;
-    int oriSize = m_headerRegions.size();
-    pmh_element_type hx[6] = {pmh_H1, pmh_H2, pmh_H3, pmh_H4, pmh_H5, pmh_H6};
-    for (int i = 0; i < 6; ++i) {
-        pmh_element *elem = result[hx[i]];
-        while (elem != NULL) {
-            if (elem->end <= elem->pos
-                || !isValidHeader(elem->pos, elem->end)) {
-                elem = elem->next;
-                continue;
-            }
-
-            if (idx < oriSize) {
-                // Try to reuse the original element.
-                VElementRegion &reg = m_headerRegions[idx];
-                if ((int)elem->pos != reg.m_startPos || (int)elem->end != reg.m_endPos) {
-                    reg.m_startPos = (int)elem->pos;
-                    reg.m_endPos = (int)elem->end;
-                }
-            } else {
-                m_headerRegions.push_back(VElementRegion(elem->pos, elem->end));
-            }
-
-            ++idx;
-            elem = elem->next;
-        }
-    }
-
-    if (idx < oriSize) {
-        m_headerRegions.resize(idx);
-    }
-
-    std::sort(m_headerRegions.begin(), m_headerRegions.end());
-
-    qDebug() << "highlighter: parse" << m_headerRegions.size() << "header regions";
-
-    emit headersUpdated(m_headerRegions);
-}
-
-void HGMarkdownHighlighter::initBlockHighlihgtOne(unsigned long pos,
-                                                  unsigned long end,
-                                                  int styleIndex)
-{
-    // When the the highlight element is at the end of document, @end will equals
-    // to the characterCount.
-    unsigned int nrChar = (unsigned int)document->characterCount();
-    if (end >= nrChar && nrChar > 0) {
-        end = nrChar - 1;
-    }
-
-    int startBlockNum = document->findBlock(pos).blockNumber();
-    int endBlockNum = document->findBlock(end).blockNumber();
-
-    for (int i = startBlockNum; i <= endBlockNum; ++i)
-    {
-        QTextBlock block = document->findBlockByNumber(i);
-        int blockStartPos = block.position();
-        HLUnit unit;
-        if (i == startBlockNum) {
-            unit.start = pos - blockStartPos;
-            unit.length = (startBlockNum == endBlockNum) ?
-                          (end - pos) : (block.length() - unit.start);
-        } else if (i == endBlockNum) {
-            unit.start = 0;
-            unit.length = end - blockStartPos;
-        } else {
-            unit.start = 0;
-            unit.length = block.length();
-        }
-        unit.styleIndex = styleIndex;
-
-        blockHighlights[i].append(unit);
-    }
-}
-
 void HGMarkdownHighlighter::highlightCodeBlock(const QString &text)
 {
     static int startLeadingSpaces = -1;
@@ -459,76 +260,329 @@ void HGMarkdownHighlighter::highlightLinkWithSpacesInURL(const QString &p_text)
     }
 }
 
-void HGMarkdownHighlighter::parse(bool p_fast)
+void HGMarkdownHighlighter::parse(bool p_fast, bool p_incremental)
 {
-    if (!parsing.testAndSetRelaxed(0, 1)) {
-        return;
+    QSharedPointer<VPegParseConfig> config(new VPegParseConfig());
+    config->m_timeStamp = ++m_parseTimeStamp;
+    config->m_revision = document->revision();
+    config->m_fast = p_fast;
+
+    config->m_styleTypes.reserve(highlightingStyles.size());
+    for (auto const &style : highlightingStyles) {
+        config->m_styleTypes.append(style.type);
     }
 
-    if (highlightingStyles.isEmpty()) {
-        goto exit;
+    // A fast parse does not update the regions, so it could not be incremental.
+    m_incrementalInfo = IncrementalParseInfo();
+    if (p_fast || !p_incremental || !prepareIncrementalParse(*config)) {
+        config->m_text = document->toRawText();
+        config->m_offset = 0;
+        config->m_startBlock = 0;
+        config->m_numOfBlocks = document->blockCount();
     }
 
-    {
-    m_blockHLResultReady = false;
+    m_parser->parseAsync(config);
+}
+
+// Whether @p_block could start a top-level Markdown block, which means it follows
+// a blank block and does not begin with spaces.
+static bool isTopLevelBlockStart(const QTextBlock &p_block)
+{
+    QTextBlock prevBlock = p_block.previous();
+    if (!prevBlock.isValid()) {
+        return true;
+    }
+
+    const QString text = p_block.text();
+    if (text.isEmpty() || text[0].isSpace()) {
+        return false;
+    }
+
+    return prevBlock.text().trimmed().isEmpty();
+}
+
+// Whether any region of @p_regions intersects with [p_start, p_end).
+static bool regionsIntersect(const QVector<VElementRegion> &p_regions, int p_start, int p_end)
+{
+    for (auto const &reg : p_regions) {
+        if (reg.m_endPos > p_start && reg.m_startPos < p_end) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Whether any region of @p_regions spans across @p_pos.
+static bool regionsStraddle(const QVector<VElementRegion> &p_regions, int p_pos)
+{
+    for (auto const &reg : p_regions) {
+        if (reg.m_startPos < p_pos && reg.m_endPos > p_pos) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Replace regions of @p_regions within [p_start, p_oldEnd) of the old document
+// with @p_newRegions and shift regions after @p_oldEnd by @p_delta.
+static void spliceRegions(QVector<VElementRegion> &p_regions,
+                          const QVector<VElementRegion> &p_newRegions,
+                          int p_start,
+                          int p_oldEnd,
+                          int p_delta)
+{
+    QVector<VElementRegion> regions;
+    regions.reserve(p_regions.size() + p_newRegions.size());
+    for (auto const &reg : p_regions) {
+        if (reg.m_endPos <= p_start) {
+            regions.append(reg);
+        }
+    }
+
+    regions.append(p_newRegions);
+
+    for (auto const &reg : p_regions) {
+        if (reg.m_startPos >= p_oldEnd) {
+            regions.append(VElementRegion(reg.m_startPos + p_delta, reg.m_endPos + p_delta));
+        }
+    }
+
+    p_regions = regions;
+}
+
+bool HGMarkdownHighlighter::prepareIncrementalParse(VPegParseConfig &p_config)
+{
+    if (!m_incrementalParseReady
+        || m_hasReferences
+        || m_dirtyStart < 0
+        || blockHighlights.size() != m_parsedBlockCount) {
+        return false;
+    }
 
+    int nrChar = document->characterCount();
     int nrBlocks = document->blockCount();
-    parseInternal();
+    int charDelta = nrChar - m_parsedCharCount;
+    int blockDelta = nrBlocks - m_parsedBlockCount;
+
+    int dirtyEnd = qBound(0, m_dirtyEnd, nrChar - 1);
+    int dirtyStart = qBound(0, m_dirtyStart, dirtyEnd);
+
+    // Expand the dirty range to top-level Markdown blocks.
+    QTextBlock startBlock = document->findBlock(dirtyStart);
+    while (!isTopLevelBlockStart(startBlock)) {
+        startBlock = startBlock.previous();
+    }
+
+    QTextBlock endBlock = document->findBlock(dirtyEnd);
+    // A blank line added or changed may change how the next top-level block is
+    // parsed, such as a setext header or a lazy continuation line.
+    bool extendToNext = endBlock.text().trimmed().isEmpty();
+    QTextBlock nextBlock = endBlock.next();
+    while (nextBlock.isValid()) {
+        if (isTopLevelBlockStart(nextBlock)) {
+            if (!extendToNext) {
+                break;
+            }
 
-    initBlockHighlightFromResult(nrBlocks);
+            extendToNext = false;
+        }
 
-    m_blockHLResultReady = true;
+        endBlock = nextBlock;
+        nextBlock = nextBlock.next();
+    }
 
-    if (!p_fast) {
-        initHtmlCommentRegionsFromResult();
+    int startBlockNum = startBlock.blockNumber();
+    int endBlockNum = endBlock.blockNumber();
+    // Blocks after @endBlockNum are unchanged and only shifted by @blockDelta.
+    int oldEndBlockNum = endBlockNum - blockDelta;
+    if (oldEndBlockNum < startBlockNum - 1 || oldEndBlockNum >= m_parsedBlockCount) {
+        return false;
+    }
 
-        initImageRegionsFromResult();
+    int regionStart = startBlock.position();
+    int regionEnd = endBlock.position() + endBlock.length();
+    if ((regionEnd - regionStart) * 2 > nrChar) {
+        // Not worth it.
+        return false;
+    }
 
-        initHeaderRegionsFromResult();
+    // HTML comments and HTML blocks may span blank lines.
+    int oldRegionEnd = regionEnd - charDelta;
+    if (regionsIntersect(m_commentRegions, regionStart, oldRegionEnd)
+        || regionsIntersect(m_htmlBlockRegions, regionStart, oldRegionEnd)) {
+        return false;
     }
 
-    if (result) {
-        pmh_free_elements(result);
-        result = NULL;
+    // Regions across the boundaries could not be spliced since only part of
+    // them is re-parsed.
+    if (regionsStraddle(m_imageRegions, regionStart)
+        || regionsStraddle(m_imageRegions, oldRegionEnd)
+        || regionsStraddle(m_headerRegions, regionStart)
+        || regionsStraddle(m_headerRegions, oldRegionEnd)) {
+        return false;
     }
+
+    QString text;
+    text.reserve(regionEnd - regionStart);
+    for (QTextBlock block = startBlock; block.isValid(); block = block.next()) {
+        QString blockText = block.text();
+        if (blockText.startsWith('<') || blockText.contains("<!--")) {
+            return false;
+        }
+
+        text += blockText;
+        text += QChar::ParagraphSeparator;
+
+        if (block == endBlock) {
+            break;
+        }
     }
 
-exit:
-    parsing.store(0);
+    p_config.m_text = text;
+    p_config.m_offset = regionStart;
+    p_config.m_startBlock = startBlockNum;
+    p_config.m_numOfBlocks = endBlockNum - startBlockNum + 1;
+
+    m_incrementalInfo.m_valid = true;
+    m_incrementalInfo.m_oldNumOfBlocks = oldEndBlockNum - startBlockNum + 1;
+    m_incrementalInfo.m_oldEndPos = oldRegionEnd;
+    m_incrementalInfo.m_charDelta = charDelta;
+
+    qDebug() << "highlighter: parse incrementally blocks" << startBlockNum << endBlockNum;
+    return true;
+}
+
+void HGMarkdownHighlighter::handleParseResult(const QSharedPointer<VPegParseResult> &p_result)
+{
+    if (p_result->m_timeStamp != m_parseTimeStamp
+        || p_result->m_revision != document->revision()) {
+        // The document has been changed. Abandon the obsolete result.
+        qDebug() << "highlighter: discard obsolete parse result" << p_result->m_timeStamp;
+        return;
+    }
+
+    if (m_incrementalInfo.m_valid) {
+        if (!applyIncrementalParseResult(*p_result)) {
+            parse(p_result->m_fast, false);
+            return;
+        }
+    } else {
+        applyParseResult(*p_result);
+    }
+
+    m_blockHLResultReady = true;
+
+    m_parsedCharCount = document->characterCount();
+    m_parsedBlockCount = document->blockCount();
+    m_dirtyStart = m_dirtyEnd = -1;
+
+    finishParseAndHighlight(p_result->m_fast);
 }
 
-void HGMarkdownHighlighter::parseInternal()
+void HGMarkdownHighlighter::applyParseResult(const VPegParseResult &p_result)
 {
-    QString text = document->toPlainText();
-    QByteArray ba = text.toUtf8();
-    const char *data = (const char *)ba.data();
-    int len = ba.size();
+    blockHighlights = p_result.m_blockHighlights;
+
+    m_hasReferences = p_result.m_hasReferences;
+    m_incrementalParseReady = !p_result.m_fast;
+
+    if (p_result.m_fast) {
+        return;
+    }
+
+    m_commentRegions = p_result.m_commentRegions;
+    m_htmlBlockRegions = p_result.m_htmlBlockRegions;
+    qDebug() << "highlighter: parse" << m_commentRegions.size() << "HTML comment regions";
+
+    m_imageRegions = p_result.m_imageRegions;
+    qDebug() << "highlighter: parse" << m_imageRegions.size() << "image regions";
+    emit imageLinksUpdated(m_imageRegions);
+
+    m_headerRegions = p_result.m_headerRegions;
+    qDebug() << "highlighter: parse" << m_headerRegions.size() << "header regions";
+    emit headersUpdated(m_headerRegions);
+}
 
-    if (result) {
-        pmh_free_elements(result);
-        result = NULL;
+bool HGMarkdownHighlighter::applyIncrementalParseResult(const VPegParseResult &p_result)
+{
+    // These elements may affect the text out of the region.
+    if (p_result.m_hasReferences
+        || !p_result.m_commentRegions.isEmpty()
+        || !p_result.m_htmlBlockRegions.isEmpty()) {
+        return false;
     }
 
-    if (len == 0) {
+    const IncrementalParseInfo &info = m_incrementalInfo;
+
+    // Splice the highlights of the region.
+    blockHighlights.remove(p_result.m_startBlock, info.m_oldNumOfBlocks);
+    blockHighlights.insert(p_result.m_startBlock,
+                           p_result.m_numOfBlocks,
+                           QVector<HLUnit>());
+    for (int i = 0; i < p_result.m_numOfBlocks; ++i) {
+        blockHighlights[p_result.m_startBlock + i] = p_result.m_blockHighlights[i];
+    }
+
+    int start = p_result.m_offset;
+    spliceRegions(m_commentRegions,
+                  QVector<VElementRegion>(),
+                  start,
+                  info.m_oldEndPos,
+                  info.m_charDelta);
+    spliceRegions(m_htmlBlockRegions,
+                  QVector<VElementRegion>(),
+                  start,
+                  info.m_oldEndPos,
+                  info.m_charDelta);
+    spliceRegions(m_imageRegions,
+                  p_result.m_imageRegions,
+                  start,
+                  info.m_oldEndPos,
+                  info.m_charDelta);
+    spliceRegions(m_headerRegions,
+                  p_result.m_headerRegions,
+                  start,
+                  info.m_oldEndPos,
+                  info.m_charDelta);
+
+    emit imageLinksUpdated(m_imageRegions);
+
+    emit headersUpdated(m_headerRegions);
+
+    return true;
+}
+
+void HGMarkdownHighlighter::updateDirtyRange(int p_position, int p_charsRemoved, int p_charsAdded)
+{
+    int end = p_position + p_charsAdded;
+    if (m_dirtyStart < 0) {
+        m_dirtyStart = p_position;
+        m_dirtyEnd = end;
         return;
-    } else if (len >= capacity) {
-        resizeBuffer(qMax(2 * capacity, len * 2));
-    } else if (len < (capacity >> 2)) {
-        resizeBuffer(qMax(capacity >> 1, len * 2));
     }
 
-    memcpy(content, data, len);
-    content[len] = '\0';
+    // Map the end of current dirty range into the changed document.
+    int oldEnd = m_dirtyEnd;
+    if (oldEnd >= p_position + p_charsRemoved) {
+        oldEnd += p_charsAdded - p_charsRemoved;
+    } else if (oldEnd > p_position) {
+        oldEnd = end;
+    }
 
-    pmh_markdown_to_elements(content, pmh_EXT_NONE, &result);
+    m_dirtyStart = qMin(m_dirtyStart, p_position);
+    m_dirtyEnd = qMax(oldEnd, end);
 }
 
-void HGMarkdownHighlighter::handleContentChange(int /* position */, int charsRemoved, int charsAdded)
+void HGMarkdownHighlighter::handleContentChange(int position, int charsRemoved, int charsAdded)
 {
     if (charsRemoved == 0 && charsAdded == 0) {
         return;
     }
 
+    updateDirtyRange(position, charsRemoved, charsAdded);
+
     timer->stop();
     timer->start();
 }
@@ -536,19 +590,101 @@ void HGMarkdownHighlighter::handleContentChange(int /* position */, int charsRem
 void HGMarkdownHighlighter::startParseAndHighlight(bool p_fast)
 {
     qDebug() << "HGMarkdownHighlighter start a new parse (fast" << p_fast << ")";
+    if (highlightingStyles.isEmpty()) {
+        finishParseAndHighlight(p_fast);
+        return;
+    }
+
     parse(p_fast);
+}
 
+void HGMarkdownHighlighter::finishParseAndHighlight(bool p_fast)
+{
     if (p_fast) {
-        rehighlight();
+        scheduleRehighlight();
     } else {
         if (!updateCodeBlocks()) {
-            rehighlight();
+            scheduleRehighlight();
         }
 
         highlightChanged();
     }
 }
 
+void HGMarkdownHighlighter::setVisibleBlockRange(int p_firstBlock, int p_lastBlock)
+{
+    m_firstVisibleBlock = p_firstBlock;
+    m_lastVisibleBlock = p_lastBlock;
+
+    // Newly visible blocks may have not been rehighlighted yet.
+    if (m_idleRehighlightTimer->isActive()) {
+        rehighlightVisibleBlocks();
+    }
+}
+
+void HGMarkdownHighlighter::scheduleRehighlight()
+{
+    m_blocksToRehighlight.fill(true, document->blockCount());
+    m_nextIdleBlock = 0;
+
+    rehighlightVisibleBlocks();
+
+    m_idleRehighlightTimer->start();
+}
+
+void HGMarkdownHighlighter::rehighlightVisibleBlocks()
+{
+    if (m_firstVisibleBlock < 0 || m_lastVisibleBlock < m_firstVisibleBlock) {
+        return;
+    }
+
+    // Blocks around the visible ones are likely to be seen soon.
+    const int margin = qMax(m_lastVisibleBlock - m_firstVisibleBlock, 10);
+    int first = qMax(m_firstVisibleBlock - margin, 0);
+    int last = qMin(m_lastVisibleBlock + margin, m_blocksToRehighlight.size() - 1);
+
+    QTextBlock block = document->findBlockByNumber(first);
+    for (int i = first; i <= last && block.isValid(); ++i, block = block.next()) {
+        if (m_blocksToRehighlight.testBit(i)) {
+            m_blocksToRehighlight.clearBit(i);
+            rehighlightBlock(block);
+        }
+    }
+}
+
+void HGMarkdownHighlighter::rehighlightInIdleTime()
+{
+    // Time in ms of one slice.
+    const qint64 timeSlice = 10;
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    // Blocks may be added or removed since scheduled. Those blocks will be
+    // handled by the next parse.
+    int nrBlocks = m_blocksToRehighlight.size();
+    QTextBlock block = document->findBlockByNumber(m_nextIdleBlock);
+    while (m_nextIdleBlock < nrBlocks && block.isValid()) {
+        if (m_blocksToRehighlight.testBit(m_nextIdleBlock)) {
+            m_blocksToRehighlight.clearBit(m_nextIdleBlock);
+            rehighlightBlock(block);
+        }
+
+        ++m_nextIdleBlock;
+        block = block.next();
+
+        if (elapsed.elapsed() >= timeSlice) {
+            break;
+        }
+    }
+
+    if (m_nextIdleBlock < nrBlocks && block.isValid()) {
+        m_idleRehighlightTimer->start();
+    } else {
+        m_blocksToRehighlight.clear();
+    }
+}
+
 void HGMarkdownHighlighter::updateHighlight()
 {
     timer->stop();
@@ -691,7 +827,7 @@ void HGMarkdownHighlighter::setCodeBlockHighlights(const QVector<HLUnitPos> &p_u
 exit:
     --m_numOfCodeBlockHighlightsToRecv;
     if (m_numOfCodeBlockHighlightsToRecv <= 0) {
-        rehighlight();
+        scheduleRehighlight();
     }
 }
 
@@ -718,24 +854,3 @@ void HGMarkdownHighlighter::highlightChanged()
     m_completeTimer->stop();
     m_completeTimer->start();
 }
-
-bool HGMarkdownHighlighter::isValidHeader(unsigned long p_pos, unsigned long p_end)
-{
-    // There must exist spaces after #s.
-    // No more than 6 #s.
-    int nrNumberSign = 0;
-    for (unsigned long i = p_pos; i < p_end; ++i) {
-        QChar ch = document->characterAt(i);
-        if (ch.isSpace()) {
-            return true;
-        } else if (ch == QChar('#')) {
-            if (++nrNumberSign > 6) {
-                return false;
-            }
-        } else {
-            return false;
-        }
-    }
-
-    return false;
-}
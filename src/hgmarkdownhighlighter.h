@@ -3,10 +3,11 @@
 
 #include <QTextCharFormat>
 #include <QSyntaxHighlighter>
-#include <QAtomicInt>
 #include <QMap>
 #include <QSet>
 #include <QString>
+#include <QSharedPointer>
+#include <QBitArray>
 
 extern "C" {
 #include <pmh_parser.h>
@@ -16,6 +17,10 @@ QT_BEGIN_NAMESPACE
 class QTextDocument;
 QT_END_NAMESPACE
 
+class VPegParser;
+struct VPegParseConfig;
+struct VPegParseResult;
+
 struct HighlightingStyle
 {
     pmh_element_type type;
@@ -131,6 +136,15 @@ public:
     // Parse and only update the highlight results for rehighlight().
     void updateHighlightFast();
 
+    // Set the range of blocks visible in the editor, which will be highlighted
+    // before other blocks.
+    // -1 if unknown.
+    void setVisibleBlockRange(int p_firstBlock, int p_lastBlock);
+
+    int getFirstVisibleBlock() const;
+
+    int getLastVisibleBlock() const;
+
 signals:
     void highlightCompleted();
 
@@ -147,12 +161,14 @@ protected:
     void highlightBlock(const QString &text) Q_DECL_OVERRIDE;
 
 public slots:
-    // Parse and rehighlight immediately.
+    // Parse in background and rehighlight once the result is ready.
     void updateHighlight();
 
 private slots:
     void handleContentChange(int position, int charsRemoved, int charsAdded);
 
+    void handleParseResult(const QSharedPointer<VPegParseResult> &p_result);
+
     // @p_fast: if true, just parse and update styles.
     void startParseAndHighlight(bool p_fast = false);
 
@@ -180,6 +196,9 @@ private:
     // All HTML comment regions.
     QVector<VElementRegion> m_commentRegions;
 
+    // All HTML block regions.
+    QVector<VElementRegion> m_htmlBlockRegions;
+
     // All image link regions.
     QVector<VElementRegion> m_imageRegions;
 
@@ -191,8 +210,6 @@ private:
     // Timer to signal highlightCompleted().
     QTimer *m_completeTimer;
 
-    QAtomicInt parsing;
-
     // Whether highlight results for blocks are ready.
     bool m_blockHLResultReady;
 
@@ -202,13 +219,70 @@ private:
     // Block number of those blocks which possible contains previewed image.
     QSet<int> m_possiblePreviewBlocks;
 
-    char *content;
-    int capacity;
-    pmh_element **result;
+    // Character range [m_dirtyStart, m_dirtyEnd) of current document which has
+    // been changed since last parse. -1 if there is no change.
+    int m_dirtyStart;
+    int m_dirtyEnd;
+
+    // Character count and block count of the document at last parse.
+    int m_parsedCharCount;
+    int m_parsedBlockCount;
+
+    // Whether the document contains reference definitions at last full parse.
+    // Reference links depend on the whole document, so we could not parse
+    // incrementally.
+    bool m_hasReferences;
+
+    // Whether results of last parse are complete so we could parse incrementally.
+    // A fast parse does not update the regions.
+    bool m_incrementalParseReady;
+
+    // Run PEG Markdown Highlight in background.
+    VPegParser *m_parser;
+
+    // Timestamp of the latest parse request. Results of other requests are obsolete.
+    long long m_parseTimeStamp;
+
+    // Block number range [m_firstVisibleBlock, m_lastVisibleBlock] visible in
+    // the editor. -1 if unknown.
+    int m_firstVisibleBlock;
+    int m_lastVisibleBlock;
+
+    // Blocks waiting to be rehighlighted. Visible blocks will be rehighlighted
+    // at once and others in idle time. Blocks keep their old formats until then.
+    QBitArray m_blocksToRehighlight;
+
+    // Next block to check when rehighlighting in idle time.
+    int m_nextIdleBlock;
+
+    // Timer to rehighlight blocks in idle time.
+    QTimer *m_idleRehighlightTimer;
+
+    // Info of the latest parse request to splice its result if it is incremental.
+    struct IncrementalParseInfo
+    {
+        IncrementalParseInfo()
+            : m_valid(false),
+              m_oldNumOfBlocks(0),
+              m_oldEndPos(0),
+              m_charDelta(0)
+        {
+        }
+
+        bool m_valid;
+
+        // Number of blocks of the region before the changes.
+        int m_oldNumOfBlocks;
+
+        // End position of the region before the changes.
+        int m_oldEndPos;
+
+        // Change of the character count of the document.
+        int m_charDelta;
+    };
 
-    static const int initCapacity;
+    IncrementalParseInfo m_incrementalInfo;
 
-    void resizeBuffer(int newCap);
     void highlightCodeBlock(const QString &text);
 
     // Highlight links using regular expression.
@@ -216,30 +290,42 @@ private:
     // intended to complement this.
     void highlightLinkWithSpacesInURL(const QString &p_text);
 
-    void parse(bool p_fast = false);
+    // Request a parse in background. handleParseResult() will be called later.
+    // @p_incremental: whether try to parse only the changed blocks.
+    void parse(bool p_fast, bool p_incremental = true);
 
-    void parseInternal();
+    // Prepare @p_config to re-parse only the top-level Markdown blocks affected
+    // by the changes since last parse.
+    // Return false if it could not be done and a full parse is needed.
+    bool prepareIncrementalParse(VPegParseConfig &p_config);
 
-    // Init highlight elements for all the blocks from parse results.
-    void initBlockHighlightFromResult(int nrBlocks);
+    // Apply the result of a full parse.
+    void applyParseResult(const VPegParseResult &p_result);
 
-    // Init highlight elements for blocks from one parse result.
-    void initBlockHighlihgtOne(unsigned long pos,
-                               unsigned long end,
-                               int styleIndex);
+    // Splice the result of an incremental parse into existing highlights.
+    // Return false if the result could not be used and a full parse is needed.
+    bool applyIncrementalParseResult(const VPegParseResult &p_result);
 
-    // Return true if there are fenced code blocks and it will call rehighlight() later.
-    // Return false if there is none.
-    bool updateCodeBlocks();
+    // Re-highlight the document after a parse.
+    void finishParseAndHighlight(bool p_fast);
+
+    // Rehighlight all the blocks, visible blocks first and others in idle time.
+    // Used instead of rehighlight() which will highlight the whole document
+    // at once.
+    void scheduleRehighlight();
+
+    // Rehighlight pending blocks within the visible range.
+    void rehighlightVisibleBlocks();
 
-    // Fetch all the HTML comment regions from parsing result.
-    void initHtmlCommentRegionsFromResult();
+    // Rehighlight pending blocks for one time slice.
+    void rehighlightInIdleTime();
 
-    // Fetch all the image link regions from parsing result.
-    void initImageRegionsFromResult();
+    // Update m_dirtyStart and m_dirtyEnd according to one content change.
+    void updateDirtyRange(int p_position, int p_charsRemoved, int p_charsAdded);
 
-    // Fetch all the header regions from parsing result.
-    void initHeaderRegionsFromResult();
+    // Return true if there are fenced code blocks and it will rehighlight later.
+    // Return false if there is none.
+    bool updateCodeBlocks();
 
     // Whether @p_block is totally inside a HTML comment.
     bool isBlockInsideCommentRegion(const QTextBlock &p_block) const;
@@ -252,9 +338,6 @@ private:
 
     // Highlight color column in code block.
     void highlightCodeBlockColorColumn(const QString &p_text);
-
-    // Check if [p_pos, p_end) is a valid header.
-    bool isValidHeader(unsigned long p_pos, unsigned long p_end);
 };
 
 inline const QVector<VElementRegion> &HGMarkdownHighlighter::getHeaderRegions() const
@@ -262,6 +345,16 @@ inline const QVector<VElementRegion> &HGMarkdownHighlighter::getHeaderRegions()
     return m_headerRegions;
 }
 
+inline int HGMarkdownHighlighter::getFirstVisibleBlock() const
+{
+    return m_firstVisibleBlock;
+}
+
+inline int HGMarkdownHighlighter::getLastVisibleBlock() const
+{
+    return m_lastVisibleBlock;
+}
+
 inline const QSet<int> &HGMarkdownHighlighter::getPossiblePreviewBlocks() const
 {
     return m_possiblePreviewBlocks;
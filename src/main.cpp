@@ -13,11 +13,15 @@
 #include "vsingleinstanceguard.h"
 #include "vconfigmanager.h"
 #include "vpalette.h"
+#include "vcodeblockhighlightcache.h"
+#include "vimageresourcemanager2.h"
 
 VConfigManager *g_config;
 
 VPalette *g_palette;
 
+VCodeBlockHighlightCache *g_codeBlockCache;
+
 #if defined(QT_NO_DEBUG)
 // 5MB log size.
 #define MAX_LOG_SIZE 5 * 1024 * 1024
@@ -170,6 +174,12 @@ int main(int argc, char *argv[])
     VPalette palette(g_config->getThemeFile());
     g_palette = &palette;
 
+    VCodeBlockHighlightCache codeBlockCache(g_config->getCodeBlockHighlightCacheSize() * 1024);
+    codeBlockCache.load(g_config->getCodeBlockHighlightCacheFilePath());
+    g_codeBlockCache = &codeBlockCache;
+
+    VImageResourceManager2::setBudget(g_config->getPreviewImageCacheSize() * 1024LL);
+
     VMainWindow w(&guard);
     QString style = palette.fetchQtStyleSheet();
     if (!style.isEmpty()) {
@@ -184,5 +194,9 @@ int main(int argc, char *argv[])
 
     w.promptNewNotebookIfEmpty();
 
-    return app.exec();
+    int ret = app.exec();
+
+    codeBlockCache.save(g_config->getCodeBlockHighlightCacheFilePath());
+
+    return ret;
 }
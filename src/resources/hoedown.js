@@ -58,9 +58,3 @@ var updateHtml = function(html) {
         finishLogics();
     }
 };
-
-var highlightText = function(text, id, timeStamp) {
-    var html = marked(text);
-    content.highlightTextCB(html, id, timeStamp);
-}
-
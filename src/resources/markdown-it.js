@@ -113,9 +113,3 @@ var updateText = function(text) {
         finishLogics();
     }
 };
-
-var highlightText = function(text, id, timeStamp) {
-    var html = mdit.render(text);
-    content.highlightTextCB(html, id, timeStamp);
-}
-
@@ -50,7 +50,7 @@ new QWebChannel(qt.webChannelTransport,
         content.requestScrollToAnchor.connect(scrollToAnchor);
 
         if (typeof highlightText == "function") {
-            content.requestHighlightText.connect(highlightText);
+            content.requestHighlightTexts.connect(highlightTexts);
             content.noticeReadyToHighlightText();
         }
     });
@@ -569,6 +569,98 @@ var escapeHtml = function(text) {
   return text.replace(/[&<>"']/g, function(m) { return map[m]; });
 };
 
+// Revert escapeHtml() and the escape of highlight.js.
+var unescapeHtml = function(text) {
+    var map = {
+        '&amp;': '&',
+        '&lt;': '<',
+        '&gt;': '>',
+        '&quot;': '"',
+        '&#039;': "'",
+        '&#x27;': "'"
+    };
+
+    return text.replace(/&(amp|lt|gt|quot|#039|#x27);/g, function(m) { return map[m]; });
+};
+
+// Highlight the code of fenced code block @text via highlight.js.
+// Pass back the classes and a flat array of (offset, length, class-id) triples,
+// in which offset is the position within @text and class-id is the index
+// in the classes.
+var highlightText = function(text, id, timeStamp) {
+    var classes = [];
+    var triples = [];
+
+    var codeStart = text.indexOf('\n') + 1;
+    var codeEnd = text.lastIndexOf('\n');
+    if (codeStart == 0 || codeEnd < codeStart) {
+        content.highlightTextCB(classes, triples, id, timeStamp);
+        return;
+    }
+
+    var lang = '';
+    var fence = /^\s*```([^`\s]*)/.exec(text.substring(0, codeStart));
+    if (fence) {
+        lang = fence[1];
+    }
+
+    var code = text.substring(codeStart, codeEnd);
+    var html;
+    if (lang && hljs.getLanguage(lang)) {
+        html = hljs.highlight(lang, code, true).value;
+    } else {
+        html = hljs.highlightAuto(code).value;
+    }
+
+    var classIds = {};
+    var spans = [];
+    var pos = codeStart;
+    var reg = /<span class="([^"]*)">|<\/span>|[^<]+/g;
+    var m;
+    while ((m = reg.exec(html)) !== null) {
+        if (m[1] !== undefined) {
+            var cls = m[1];
+            if (!(cls in classIds)) {
+                classIds[cls] = classes.length;
+                classes.push(cls);
+            }
+
+            spans.push([pos, classIds[cls]]);
+        } else if (m[0] == '</span>') {
+            var span = spans.pop();
+            if (span && pos > span[0]) {
+                triples.push(span[0], pos - span[0], span[1]);
+            }
+        } else {
+            pos += unescapeHtml(m[0]).length;
+        }
+    }
+
+    content.highlightTextCB(classes, triples, id, timeStamp);
+};
+
+// Timestamp of the latest batch of code blocks to highlight.
+var highlightTimeStamp = -1;
+
+// Highlight a batch of code blocks one by one, yielding between blocks so
+// that a newer batch could cancel this one.
+var highlightTexts = function(texts, ids, timeStamp) {
+    highlightTimeStamp = timeStamp;
+
+    var idx = 0;
+    var highlightNext = function() {
+        if (timeStamp != highlightTimeStamp || idx >= texts.length) {
+            return;
+        }
+
+        highlightText(texts[idx], ids[idx], timeStamp);
+        ++idx;
+        setTimeout(highlightNext, 0);
+    };
+
+    highlightNext();
+};
+
 // Return the topest level of @toc, starting from 1.
 var baseLevelOfToc = function(p_toc) {
     var level = -1;
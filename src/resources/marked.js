@@ -65,9 +65,3 @@ var updateText = function(text) {
         finishLogics();
     }
 };
-
-var highlightText = function(text, id, timeStamp) {
-    var html = marked(text);
-    content.highlightTextCB(html, id, timeStamp);
-}
-
@@ -92,18 +92,3 @@ var updateText = function(text) {
         finishLogics();
     }
 };
-
-var highlightText = function(text, id, timeStamp) {
-    var html = renderer.makeHtml(text);
-
-    var parser = new DOMParser();
-    var htmlDoc = parser.parseFromString("<div id=\"showdown-container\">" + html + "</div>", 'text/html');
-    highlightCodeBlocks(htmlDoc, false, false);
-
-    html = htmlDoc.getElementById('showdown-container').innerHTML;
-
-    delete parser;
-
-    content.highlightTextCB(html, id, timeStamp);
-}
-
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui webenginewidgets webchannel network svg printsupport
+QT       += core gui webenginewidgets webchannel network svg printsupport concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -102,7 +102,12 @@ SOURCES += main.cpp\
     vpalette.cpp \
     vbuttonmenuitem.cpp \
     utils/viconutils.cpp \
-    lineeditdelegate.cpp
+    lineeditdelegate.cpp \
+    vpegparser.cpp \
+    vcodeblocktokenizer.cpp \
+    vcodeblockhighlightcache.cpp \
+    vblocksizetree.cpp \
+    vnotebookindex.cpp
 
 HEADERS  += vmainwindow.h \
     vdirectorytree.h \
@@ -191,7 +196,12 @@ HEADERS  += vmainwindow.h \
     vpalette.h \
     vbuttonmenuitem.h \
     utils/viconutils.h \
-    lineeditdelegate.h
+    lineeditdelegate.h \
+    vpegparser.h \
+    vcodeblocktokenizer.h \
+    vcodeblockhighlightcache.h \
+    vblocksizetree.h \
+    vnotebookindex.h
 
 RESOURCES += \
     vnote.qrc \
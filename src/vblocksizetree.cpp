@@ -0,0 +1,356 @@
+#include "vblocksizetree.h"
+
+const int VBlockSizeTree::c_chunkSize = 128;
+
+void VBlockSizeTree::Chunk::update()
+{
+    m_height = 0;
+    for (auto height : m_heights) {
+        m_height += height;
+    }
+
+    updateWidest();
+}
+
+void VBlockSizeTree::Chunk::updateWidest()
+{
+    m_widest = -1;
+    for (int i = 0; i < m_widths.size(); ++i) {
+        if (m_widest == -1 || m_widths[i] > m_widths[m_widest]) {
+            m_widest = i;
+        }
+    }
+}
+
+VBlockSizeTree::VBlockSizeTree()
+    : m_count(0),
+      m_countTree(1, 0),
+      m_heightTree(1, 0),
+      m_widthTree(2, 0),
+      m_leafBase(1)
+{
+}
+
+void VBlockSizeTree::build(const QVector<qreal> &p_heights, const QVector<qreal> &p_widths)
+{
+    Q_ASSERT(p_heights.size() == p_widths.size());
+    m_count = p_heights.size();
+
+    m_chunks.clear();
+    m_chunks.reserve((m_count + c_chunkSize - 1) / c_chunkSize);
+    for (int i = 0; i < m_count; i += c_chunkSize) {
+        int size = qMin(c_chunkSize, m_count - i);
+        Chunk chunk;
+        chunk.m_heights = p_heights.mid(i, size);
+        chunk.m_widths = p_widths.mid(i, size);
+        chunk.update();
+        m_chunks.append(chunk);
+    }
+
+    rebuildChunkIndex();
+}
+
+void VBlockSizeTree::rebuildChunkIndex()
+{
+    int cnt = m_chunks.size();
+
+    m_countTree.fill(0, cnt + 1);
+    m_heightTree.fill(0, cnt + 1);
+    for (int i = 1; i <= cnt; ++i) {
+        m_countTree[i] += m_chunks[i - 1].size();
+        m_heightTree[i] += m_chunks[i - 1].m_height;
+        int parent = i + (i & -i);
+        if (parent <= cnt) {
+            m_countTree[parent] += m_countTree[i];
+            m_heightTree[parent] += m_heightTree[i];
+        }
+    }
+
+    m_leafBase = 1;
+    while (m_leafBase < cnt) {
+        m_leafBase <<= 1;
+    }
+
+    m_widthTree.fill(0, 2 * m_leafBase);
+    for (int i = 0; i < cnt; ++i) {
+        m_widthTree[m_leafBase + i] = m_chunks[i].maximumWidth();
+    }
+
+    for (int i = m_leafBase - 1; i > 0; --i) {
+        m_widthTree[i] = qMax(m_widthTree[2 * i], m_widthTree[2 * i + 1]);
+    }
+}
+
+void VBlockSizeTree::locate(int p_idx, int &p_chunk, int &p_local) const
+{
+    int cnt = m_chunks.size();
+    int step = 1;
+    while ((step << 1) <= cnt) {
+        step <<= 1;
+    }
+
+    // Find the largest chunk with chunkStart(chunk) <= p_idx.
+    int chunk = 0;
+    for (; step > 0; step >>= 1) {
+        int next = chunk + step;
+        if (next <= cnt && m_countTree[next] <= p_idx) {
+            chunk = next;
+            p_idx -= m_countTree[next];
+        }
+    }
+
+    p_chunk = chunk;
+    p_local = p_idx;
+}
+
+int VBlockSizeTree::chunkStart(int p_chunk) const
+{
+    int sum = 0;
+    for (int i = p_chunk; i > 0; i -= (i & -i)) {
+        sum += m_countTree[i];
+    }
+
+    return sum;
+}
+
+qreal VBlockSizeTree::chunkOffset(int p_chunk) const
+{
+    qreal sum = 0;
+    for (int i = p_chunk; i > 0; i -= (i & -i)) {
+        sum += m_heightTree[i];
+    }
+
+    return sum;
+}
+
+void VBlockSizeTree::updateChunkWidth(int p_chunk)
+{
+    int node = m_leafBase + p_chunk;
+    qreal width = m_chunks[p_chunk].maximumWidth();
+    if (m_widthTree[node] == width) {
+        return;
+    }
+
+    m_widthTree[node] = width;
+    for (node >>= 1; node > 0; node >>= 1) {
+        width = qMax(m_widthTree[2 * node], m_widthTree[2 * node + 1]);
+        if (m_widthTree[node] == width) {
+            break;
+        }
+
+        m_widthTree[node] = width;
+    }
+}
+
+void VBlockSizeTree::setSize(int p_idx, qreal p_height, qreal p_width)
+{
+    Q_ASSERT(p_idx >= 0 && p_idx < m_count);
+    int idx, local;
+    locate(p_idx, idx, local);
+    Chunk &chunk = m_chunks[idx];
+
+    qreal delta = p_height - chunk.m_heights[local];
+    if (delta != 0) {
+        chunk.m_heights[local] = p_height;
+        chunk.m_height += delta;
+        for (int i = idx + 1; i < m_heightTree.size(); i += (i & -i)) {
+            m_heightTree[i] += delta;
+        }
+    }
+
+    if (chunk.m_widths[local] != p_width) {
+        chunk.m_widths[local] = p_width;
+        if (local == chunk.m_widest) {
+            chunk.updateWidest();
+        } else if (p_width > chunk.maximumWidth()
+                   || (p_width == chunk.maximumWidth() && local < chunk.m_widest)) {
+            chunk.m_widest = local;
+        }
+
+        updateChunkWidth(idx);
+    }
+}
+
+qreal VBlockSizeTree::height(int p_idx) const
+{
+    Q_ASSERT(p_idx >= 0 && p_idx < m_count);
+    int idx, local;
+    locate(p_idx, idx, local);
+    return m_chunks[idx].m_heights[local];
+}
+
+void VBlockSizeTree::insert(int p_idx, int p_count)
+{
+    Q_ASSERT(p_idx >= 0 && p_idx <= m_count);
+    if (p_count <= 0) {
+        return;
+    }
+
+    int idx, local;
+    if (m_chunks.isEmpty()) {
+        m_chunks.append(Chunk());
+        idx = local = 0;
+    } else if (p_idx == m_count) {
+        // Append to the last chunk.
+        idx = m_chunks.size() - 1;
+        local = m_chunks[idx].size();
+    } else {
+        locate(p_idx, idx, local);
+    }
+
+    Chunk &chunk = m_chunks[idx];
+    chunk.m_heights.insert(local, p_count, 0);
+    chunk.m_widths.insert(local, p_count, 0);
+    chunk.updateWidest();
+    m_count += p_count;
+
+    splitChunk(idx);
+
+    rebuildChunkIndex();
+}
+
+void VBlockSizeTree::remove(int p_idx, int p_count)
+{
+    Q_ASSERT(p_idx >= 0 && p_idx + p_count <= m_count);
+    if (p_count <= 0) {
+        return;
+    }
+
+    int first, local;
+    locate(p_idx, first, local);
+
+    int idx = first;
+    int left = p_count;
+    while (left > 0) {
+        Chunk &chunk = m_chunks[idx];
+        int cnt = qMin(left, chunk.size() - local);
+        chunk.m_heights.remove(local, cnt);
+        chunk.m_widths.remove(local, cnt);
+        chunk.update();
+
+        left -= cnt;
+        local = 0;
+        ++idx;
+    }
+
+    m_count -= p_count;
+
+    // Drop the emptied chunks.
+    for (int i = idx - 1; i >= first; --i) {
+        if (m_chunks[i].size() == 0) {
+            m_chunks.remove(i);
+        }
+    }
+
+    // Merge the chunks around the removed blocks.
+    mergeChunk(first);
+    mergeChunk(first - 1);
+
+    rebuildChunkIndex();
+}
+
+void VBlockSizeTree::splitChunk(int p_chunk)
+{
+    if (m_chunks[p_chunk].size() <= 2 * c_chunkSize) {
+        return;
+    }
+
+    Chunk chunk = m_chunks[p_chunk];
+    int nrChunks = (chunk.size() + c_chunkSize - 1) / c_chunkSize;
+    m_chunks.insert(p_chunk + 1, nrChunks - 1, Chunk());
+    for (int i = 0; i < nrChunks; ++i) {
+        Chunk &piece = m_chunks[p_chunk + i];
+        piece.m_heights = chunk.m_heights.mid(i * c_chunkSize, c_chunkSize);
+        piece.m_widths = chunk.m_widths.mid(i * c_chunkSize, c_chunkSize);
+        piece.update();
+    }
+}
+
+void VBlockSizeTree::mergeChunk(int p_chunk)
+{
+    if (p_chunk < 0 || p_chunk + 1 >= m_chunks.size()) {
+        return;
+    }
+
+    Chunk &chunk = m_chunks[p_chunk];
+    const Chunk &next = m_chunks[p_chunk + 1];
+    if (chunk.size() + next.size() > c_chunkSize) {
+        return;
+    }
+
+    chunk.m_heights += next.m_heights;
+    chunk.m_widths += next.m_widths;
+    chunk.update();
+    m_chunks.remove(p_chunk + 1);
+}
+
+qreal VBlockSizeTree::offset(int p_idx) const
+{
+    Q_ASSERT(p_idx >= 0 && p_idx <= m_count);
+    if (p_idx == m_count) {
+        return totalHeight();
+    }
+
+    int idx, local;
+    locate(p_idx, idx, local);
+    qreal sum = chunkOffset(idx);
+    const Chunk &chunk = m_chunks[idx];
+    for (int i = 0; i < local; ++i) {
+        sum += chunk.m_heights[i];
+    }
+
+    return sum;
+}
+
+int VBlockSizeTree::findByOffset(qreal p_y) const
+{
+    if (p_y < 0) {
+        return -1;
+    }
+
+    int cnt = m_chunks.size();
+    int step = 1;
+    while ((step << 1) <= cnt) {
+        step <<= 1;
+    }
+
+    // Find the largest chunk with chunkOffset(chunk) <= p_y.
+    int chunk = 0;
+    int idx = 0;
+    for (; step > 0; step >>= 1) {
+        int next = chunk + step;
+        if (next <= cnt && m_heightTree[next] <= p_y) {
+            chunk = next;
+            p_y -= m_heightTree[next];
+            idx += m_countTree[next];
+        }
+    }
+
+    if (chunk < cnt) {
+        for (auto height : m_chunks[chunk].m_heights) {
+            if (height > p_y) {
+                break;
+            }
+
+            p_y -= height;
+            ++idx;
+        }
+    }
+
+    return idx;
+}
+
+int VBlockSizeTree::maximumWidthIndex() const
+{
+    if (m_count == 0) {
+        return -1;
+    }
+
+    int node = 1;
+    while (node < m_leafBase) {
+        node = m_widthTree[2 * node] == m_widthTree[node] ? 2 * node : 2 * node + 1;
+    }
+
+    int chunk = node - m_leafBase;
+    return chunkStart(chunk) + m_chunks[chunk].m_widest;
+}
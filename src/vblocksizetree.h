@@ -0,0 +1,140 @@
+#ifndef VBLOCKSIZETREE_H
+#define VBLOCKSIZETREE_H
+
+#include <QtGlobal>
+#include <QVector>
+
+// Index of the sizes of the blocks of a document.
+// Blocks are grouped into chunks of about c_chunkSize blocks. Fenwick trees
+// over the chunks give the Y offset of a block and the block at a given Y
+// offset, and a segment tree over the chunks gives the widest block.
+// Blocks could be inserted or removed in O(c_chunkSize + n / c_chunkSize)
+// without touching the sizes of other blocks.
+class VBlockSizeTree
+{
+public:
+    VBlockSizeTree();
+
+    // Rebuild the index with all the blocks in O(n).
+    void build(const QVector<qreal> &p_heights, const QVector<qreal> &p_widths);
+
+    int count() const;
+
+    void setSize(int p_idx, qreal p_height, qreal p_width);
+
+    qreal height(int p_idx) const;
+
+    // Insert @p_count blocks of zero size before block @p_idx.
+    void insert(int p_idx, int p_count);
+
+    // Remove blocks [p_idx, p_idx + p_count).
+    void remove(int p_idx, int p_count);
+
+    // Sum of the heights of blocks [0, p_idx).
+    qreal offset(int p_idx) const;
+
+    qreal totalHeight() const;
+
+    // Return the block containing offset @p_y, which means offset(idx) <= @p_y
+    // and offset(idx + 1) > @p_y. Blocks of zero height are skipped.
+    // Return -1 if @p_y < 0, and count() if @p_y >= totalHeight().
+    int findByOffset(qreal p_y) const;
+
+    qreal maximumWidth() const;
+
+    // Return the widest block, or -1 if there is no block.
+    int maximumWidthIndex() const;
+
+private:
+    struct Chunk
+    {
+        Chunk()
+            : m_height(0),
+              m_widest(-1)
+        {
+        }
+
+        int size() const
+        {
+            return m_heights.size();
+        }
+
+        qreal maximumWidth() const
+        {
+            return m_widest == -1 ? 0 : m_widths[m_widest];
+        }
+
+        // Recalculate m_height and m_widest.
+        void update();
+
+        // Recalculate m_widest.
+        void updateWidest();
+
+        QVector<qreal> m_heights;
+
+        QVector<qreal> m_widths;
+
+        // Sum of m_heights.
+        qreal m_height;
+
+        // Index of the first widest block within the chunk, or -1 if empty.
+        int m_widest;
+    };
+
+    // Find the chunk containing block @p_idx and its index within the chunk.
+    void locate(int p_idx, int &p_chunk, int &p_local) const;
+
+    // Number of blocks of chunks [0, p_chunk).
+    int chunkStart(int p_chunk) const;
+
+    // Sum of the heights of chunks [0, p_chunk).
+    qreal chunkOffset(int p_chunk) const;
+
+    // Update the width of chunk @p_chunk in the segment tree.
+    void updateChunkWidth(int p_chunk);
+
+    // Split chunk @p_chunk if it is too large.
+    void splitChunk(int p_chunk);
+
+    // Merge chunk @p_chunk with the next one if both are small.
+    void mergeChunk(int p_chunk);
+
+    // Rebuild the trees over the chunks in O(n / c_chunkSize).
+    void rebuildChunkIndex();
+
+    QVector<Chunk> m_chunks;
+
+    // Number of blocks.
+    int m_count;
+
+    // Fenwick tree of the number of blocks of each chunk, 1-based.
+    QVector<int> m_countTree;
+
+    // Fenwick tree of the heights of each chunk, 1-based.
+    QVector<qreal> m_heightTree;
+
+    // Segment tree of the widths of each chunk with leaves starting from
+    // m_leafBase.
+    QVector<qreal> m_widthTree;
+
+    int m_leafBase;
+
+    // Number of blocks of a chunk when built or split.
+    static const int c_chunkSize;
+};
+
+inline int VBlockSizeTree::count() const
+{
+    return m_count;
+}
+
+inline qreal VBlockSizeTree::totalHeight() const
+{
+    return chunkOffset(m_chunks.size());
+}
+
+inline qreal VBlockSizeTree::maximumWidth() const
+{
+    return m_count == 0 ? 0 : m_widthTree[1];
+}
+#endif // VBLOCKSIZETREE_H
@@ -0,0 +1,248 @@
+#include "vcodeblockhighlightcache.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QHash>
+#include <QStringList>
+
+// Magic number and format version of the cache file.
+static const quint32 c_cacheFileMagic = 0x56434248; // VCBH
+static const quint32 c_cacheFileVersion = 1;
+
+VCodeBlockCacheKey::VCodeBlockCacheKey(const QString &p_text,
+                                       const QString &p_lang,
+                                       quint32 p_version)
+    : m_length(p_text.size()),
+      m_lang(p_lang),
+      m_version(p_version)
+{
+    const quint64 fnvOffsetBasis = 14695981039346656037ULL;
+    const quint64 fnvPrime = 1099511628211ULL;
+
+    m_hash = fnvOffsetBasis;
+    const ushort *data = p_text.utf16();
+    for (int i = 0; i < m_length; ++i) {
+        m_hash ^= data[i] & 0xff;
+        m_hash *= fnvPrime;
+        m_hash ^= data[i] >> 8;
+        m_hash *= fnvPrime;
+    }
+}
+
+VCodeBlockHighlightCache::VCodeBlockHighlightCache(int p_budget)
+    : m_budget(p_budget),
+      m_usedBytes(0),
+      m_hits(0),
+      m_misses(0),
+      m_evictions(0)
+{
+}
+
+bool VCodeBlockHighlightCache::find(const VCodeBlockCacheKey &p_key, QVector<HLUnitPos> &p_units)
+{
+    auto it = m_entries.find(p_key);
+    if (it == m_entries.end()) {
+        ++m_misses;
+        return false;
+    }
+
+    // Make it the most recently used one.
+    Entry &entry = it.value();
+    m_lru.erase(entry.m_lruIt);
+    m_lru.prepend(p_key);
+    entry.m_lruIt = m_lru.begin();
+
+    ++m_hits;
+    p_units = entry.m_units;
+    return true;
+}
+
+void VCodeBlockHighlightCache::insert(const VCodeBlockCacheKey &p_key,
+                                      const QVector<HLUnitPos> &p_units)
+{
+    remove(p_key);
+
+    int cost = estimateCost(p_units);
+    if (cost > m_budget) {
+        // Larger than the whole budget.
+        ++m_evictions;
+        return;
+    }
+
+    m_lru.prepend(p_key);
+
+    Entry &entry = m_entries[p_key];
+    entry.m_units = p_units;
+    entry.m_cost = cost;
+    entry.m_lruIt = m_lru.begin();
+    m_usedBytes += cost;
+
+    int nrEvicted = trim();
+    if (nrEvicted > 0) {
+        m_evictions += nrEvicted;
+        qDebug() << "code block highlight cache evicted" << nrEvicted << "entries"
+                 << "hits" << m_hits << "misses" << m_misses
+                 << "evictions" << m_evictions
+                 << "used" << m_usedBytes << "/" << m_budget;
+    }
+}
+
+void VCodeBlockHighlightCache::remove(const VCodeBlockCacheKey &p_key)
+{
+    auto it = m_entries.find(p_key);
+    if (it == m_entries.end()) {
+        return;
+    }
+
+    m_usedBytes -= it.value().m_cost;
+    m_lru.erase(it.value().m_lruIt);
+    m_entries.erase(it);
+}
+
+int VCodeBlockHighlightCache::trim()
+{
+    int nrEvicted = 0;
+    while (m_usedBytes > m_budget && !m_lru.isEmpty()) {
+        VCodeBlockCacheKey key = m_lru.last();
+        remove(key);
+        ++nrEvicted;
+    }
+
+    return nrEvicted;
+}
+
+void VCodeBlockHighlightCache::clear()
+{
+    m_entries.clear();
+    m_lru.clear();
+    m_usedBytes = 0;
+}
+
+// The file contains a table of the style names followed by the entries, in
+// which the styles are stored as indexes to the table.
+// Entries are stored from the least recently used one to the most, so
+// inserting them in order restores the LRU order.
+bool VCodeBlockHighlightCache::load(const QString &p_file)
+{
+    QFile file(p_file);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic, version;
+    in >> magic >> version;
+    if (magic != c_cacheFileMagic || version != c_cacheFileVersion) {
+        qWarning() << "ignore code block highlight cache file of unknown format" << p_file;
+        return false;
+    }
+
+    QStringList styles;
+    qint32 nrEntries;
+    in >> styles >> nrEntries;
+
+    // Size in the file of one unit.
+    const qint64 unitSize = sizeof(qint32) * 2 + sizeof(quint16);
+
+    for (int i = 0; i < nrEntries && in.status() == QDataStream::Ok; ++i) {
+        VCodeBlockCacheKey key;
+        qint32 length, nrUnits;
+        in >> key.m_hash >> length >> key.m_lang >> key.m_version >> nrUnits;
+        key.m_length = length;
+        // Do not trust the count of a corrupted file.
+        if (nrUnits < 0 || nrUnits * unitSize > file.bytesAvailable()) {
+            in.setStatus(QDataStream::ReadCorruptData);
+            break;
+        }
+
+        QVector<HLUnitPos> units;
+        units.reserve(nrUnits);
+        for (int j = 0; j < nrUnits; ++j) {
+            qint32 pos, len;
+            quint16 styleIdx;
+            in >> pos >> len >> styleIdx;
+            if (styleIdx >= styles.size()) {
+                in.setStatus(QDataStream::ReadCorruptData);
+                break;
+            }
+
+            // Style strings are shared via the table.
+            units.append(HLUnitPos(pos, len, styles[styleIdx]));
+        }
+
+        if (in.status() == QDataStream::Ok) {
+            insert(key, units);
+        }
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "code block highlight cache file is corrupted" << p_file;
+    }
+
+    qDebug() << "load" << m_entries.size() << "code block highlight cache entries from" << p_file;
+    return in.status() == QDataStream::Ok;
+}
+
+bool VCodeBlockHighlightCache::save(const QString &p_file)
+{
+    qDebug() << "code block highlight cache hits" << m_hits
+             << "misses" << m_misses
+             << "evictions" << m_evictions
+             << "entries" << m_entries.size()
+             << "used" << m_usedBytes << "/" << m_budget;
+
+    QStringList styles;
+    QHash<QString, int> styleIndexes;
+    for (auto const &entry : m_entries) {
+        for (auto const &unit : entry.m_units) {
+            if (!styleIndexes.contains(unit.m_style)) {
+                styleIndexes.insert(unit.m_style, styles.size());
+                styles.append(unit.m_style);
+            }
+        }
+    }
+
+    QSaveFile file(p_file);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "fail to open code block highlight cache file" << p_file;
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << c_cacheFileMagic << c_cacheFileVersion << styles << (qint32)m_entries.size();
+
+    // From the least recently used one to the most.
+    auto it = m_lru.constEnd();
+    while (it != m_lru.constBegin()) {
+        --it;
+        const VCodeBlockCacheKey &key = *it;
+        const QVector<HLUnitPos> &units = m_entries.constFind(key).value().m_units;
+        out << key.m_hash << (qint32)key.m_length << key.m_lang << key.m_version
+            << (qint32)units.size();
+        for (auto const &unit : units) {
+            out << (qint32)unit.m_position
+                << (qint32)unit.m_length
+                << (quint16)styleIndexes.value(unit.m_style);
+        }
+    }
+
+    return file.commit();
+}
+
+int VCodeBlockHighlightCache::estimateCost(const QVector<HLUnitPos> &p_units)
+{
+    // Overhead of the key, the hash and list nodes and the QVector.
+    int cost = sizeof(VCodeBlockCacheKey) + 64;
+    for (auto const &unit : p_units) {
+        // Style strings are not shared generally.
+        cost += sizeof(HLUnitPos) + 24 + unit.m_style.size() * sizeof(QChar);
+    }
+
+    return cost;
+}
@@ -0,0 +1,157 @@
+#ifndef VCODEBLOCKHIGHLIGHTCACHE_H
+#define VCODEBLOCKHIGHLIGHTCACHE_H
+
+#include <QHash>
+#include <QLinkedList>
+#include <QString>
+#include <QVector>
+
+#include "hgmarkdownhighlighter.h"
+
+// Key of a code block in the cache.
+// Use the hash of the text instead of the text itself to save memory and
+// avoid comparing the whole text.
+struct VCodeBlockCacheKey
+{
+    VCodeBlockCacheKey() : m_hash(0), m_length(0), m_version(0)
+    {
+    }
+
+    VCodeBlockCacheKey(const QString &p_text, const QString &p_lang, quint32 p_version);
+
+    bool operator==(const VCodeBlockCacheKey &p_other) const
+    {
+        return m_hash == p_other.m_hash
+               && m_length == p_other.m_length
+               && m_version == p_other.m_version
+               && m_lang == p_other.m_lang;
+    }
+
+    // 64-bit FNV-1a hash of the text.
+    quint64 m_hash;
+
+    // Length of the text.
+    int m_length;
+
+    QString m_lang;
+
+    // Version of the highlighter which produces the results.
+    quint32 m_version;
+};
+
+inline uint qHash(const VCodeBlockCacheKey &p_key, uint p_seed = 0)
+{
+    return (uint)(p_key.m_hash ^ (p_key.m_hash >> 32))
+           ^ p_key.m_version
+           ^ qHash(p_key.m_lang, p_seed);
+}
+
+
+// LRU cache of highlight results of code blocks within a memory budget.
+// The results have relative position only.
+// Shared by all the editors and persisted across sessions.
+class VCodeBlockHighlightCache
+{
+public:
+    // @p_budget: memory budget in bytes.
+    explicit VCodeBlockHighlightCache(int p_budget);
+
+    // Return true and fill @p_units if hit.
+    bool find(const VCodeBlockCacheKey &p_key, QVector<HLUnitPos> &p_units);
+
+    void insert(const VCodeBlockCacheKey &p_key, const QVector<HLUnitPos> &p_units);
+
+    void clear();
+
+    // Load entries from cache file @p_file.
+    bool load(const QString &p_file);
+
+    // Save all the entries to cache file @p_file, from the least recently
+    // used one to the most, without changing their order.
+    bool save(const QString &p_file);
+
+    // Estimated memory used in bytes.
+    int usedBytes() const;
+
+    int budget() const;
+
+    int count() const;
+
+    qint64 hits() const;
+
+    qint64 misses() const;
+
+    qint64 evictions() const;
+
+private:
+    struct Entry
+    {
+        Entry()
+            : m_cost(0)
+        {
+        }
+
+        QVector<HLUnitPos> m_units;
+
+        int m_cost;
+
+        // Position in m_lru.
+        QLinkedList<VCodeBlockCacheKey>::iterator m_lruIt;
+    };
+
+    // Remove entry @p_key if exists.
+    void remove(const VCodeBlockCacheKey &p_key);
+
+    // Remove the least recently used entries to fit in the budget.
+    // Return the number of removed entries.
+    int trim();
+
+    // Estimate the memory used by @p_units.
+    static int estimateCost(const QVector<HLUnitPos> &p_units);
+
+    QHash<VCodeBlockCacheKey, Entry> m_entries;
+
+    // Keys from the most recently used one to the least.
+    QLinkedList<VCodeBlockCacheKey> m_lru;
+
+    int m_budget;
+
+    int m_usedBytes;
+
+    qint64 m_hits;
+
+    qint64 m_misses;
+
+    qint64 m_evictions;
+};
+
+inline int VCodeBlockHighlightCache::usedBytes() const
+{
+    return m_usedBytes;
+}
+
+inline int VCodeBlockHighlightCache::budget() const
+{
+    return m_budget;
+}
+
+inline int VCodeBlockHighlightCache::count() const
+{
+    return m_entries.size();
+}
+
+inline qint64 VCodeBlockHighlightCache::hits() const
+{
+    return m_hits;
+}
+
+inline qint64 VCodeBlockHighlightCache::misses() const
+{
+    return m_misses;
+}
+
+inline qint64 VCodeBlockHighlightCache::evictions() const
+{
+    return m_evictions;
+}
+#endif // VCODEBLOCKHIGHLIGHTCACHE_H
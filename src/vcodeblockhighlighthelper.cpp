@@ -2,8 +2,19 @@
 
 #include <QDebug>
 #include <QStringList>
+#include <QThread>
+#include <algorithm>
 #include "vdocument.h"
 #include "utils/vutils.h"
+#include "vcodeblocktokenizer.h"
+#include "vcodeblockhighlightcache.h"
+
+extern VConfigManager *g_config;
+
+extern VCodeBlockHighlightCache *g_codeBlockCache;
+
+// Version of the results from the web side, which is highlight.js 9.12.0.
+static const quint32 c_webHighlighterVersion = 0x80090c00;
 
 VCodeBlockHighlightHelper::VCodeBlockHighlightHelper(HGMarkdownHighlighter *p_highlighter,
                                                      VDocument *p_vdoc,
@@ -12,7 +23,8 @@ VCodeBlockHighlightHelper::VCodeBlockHighlightHelper(HGMarkdownHighlighter *p_hi
       m_highlighter(p_highlighter),
       m_vdocument(p_vdoc),
       m_type(p_type),
-      m_timeStamp(0)
+      m_timeStamp(0),
+      m_pendingWebResults(0)
 {
     connect(m_highlighter, &HGMarkdownHighlighter::codeBlocksUpdated,
             this, &VCodeBlockHighlightHelper::handleCodeBlocksUpdated);
@@ -22,6 +34,27 @@ VCodeBlockHighlightHelper::VCodeBlockHighlightHelper(HGMarkdownHighlighter *p_hi
     // Web side is ready for code block highlight.
     connect(m_vdocument, &VDocument::readyToHighlightText,
             m_highlighter, &HGMarkdownHighlighter::updateHighlight);
+
+    qRegisterMetaType<QVector<HLUnitPos>>();
+
+    m_tokenizerThread = new QThread(this);
+    m_tokenizer = new VCodeBlockTokenizerWorker();
+    m_tokenizer->moveToThread(m_tokenizerThread);
+
+    connect(m_tokenizerThread, &QThread::finished,
+            m_tokenizer, &QObject::deleteLater);
+    connect(this, &VCodeBlockHighlightHelper::requestTokenize,
+            m_tokenizer, &VCodeBlockTokenizerWorker::tokenize);
+    connect(m_tokenizer, &VCodeBlockTokenizerWorker::tokenizeFinished,
+            this, &VCodeBlockHighlightHelper::handleTokenizeResult);
+
+    m_tokenizerThread->start();
+}
+
+VCodeBlockHighlightHelper::~VCodeBlockHighlightHelper()
+{
+    m_tokenizerThread->quit();
+    m_tokenizerThread->wait();
 }
 
 QString VCodeBlockHighlightHelper::unindentCodeBlock(const QString &p_text)
@@ -59,34 +92,76 @@ QString VCodeBlockHighlightHelper::unindentCodeBlock(const QString &p_text)
 
 void VCodeBlockHighlightHelper::handleCodeBlocksUpdated(const QVector<VCodeBlock> &p_codeBlocks)
 {
-    if (!m_vdocument->isReadyToHighlight()) {
-        // Immediately return empty results.
-        QVector<HLUnitPos> emptyRes;
-        for (int i = 0; i < p_codeBlocks.size(); ++i) {
-            updateHighlightResults(0, emptyRes);
-        }
-
-        return;
-    }
-
     int curStamp = m_timeStamp.fetchAndAddRelaxed(1) + 1;
+    m_tokenizer->setLatestTimeStamp(curStamp);
     m_codeBlocks = p_codeBlocks;
-    for (int i = 0; i < m_codeBlocks.size(); ++i) {
+    bool nativeEnabled = g_config->getEnableNativeCodeBlockHighlight();
+
+    // Code blocks to highlight via the web side in one batch.
+    QStringList webTexts;
+    QJsonArray webIds;
+
+    QVector<int> order = blocksInVisibleOrder();
+    for (int i : order) {
         const VCodeBlock &block = m_codeBlocks[i];
-        auto it = m_cache.find(block.m_text);
-        if (it != m_cache.end()) {
+        bool native = nativeEnabled && VCodeBlockTokenizer::isLanguageSupported(block.m_lang);
+        QVector<HLUnitPos> units;
+        if (g_codeBlockCache->find(cacheKey(block, native), units)) {
             // Hit cache.
             qDebug() << "code block highlight hit cache" << curStamp << i;
-            it.value().m_timeStamp = curStamp;
-            updateHighlightResults(block.m_startPos, it.value().m_units);
+            updateHighlightResults(block.m_startPos, units);
+        } else if (native) {
+            emit requestTokenize(block.m_text, block.m_lang, i, curStamp);
+        } else if (m_vdocument->isReadyToHighlight()) {
+            webTexts.append(unindentCodeBlock(block.m_text));
+            webIds.append(i);
         } else {
-            QString unindentedText = unindentCodeBlock(block.m_text);
-            m_vdocument->highlightTextAsync(unindentedText, i, curStamp);
+            // Immediately return empty results.
+            updateHighlightResults(0, QVector<HLUnitPos>());
         }
     }
+
+    // An empty batch cancels the one in flight.
+    if (!webTexts.isEmpty() || m_pendingWebResults > 0) {
+        m_vdocument->highlightTextsAsync(webTexts, webIds, curStamp);
+        m_pendingWebResults = webTexts.size();
+    }
 }
 
-void VCodeBlockHighlightHelper::handleTextHighlightResult(const QString &p_html,
+QVector<int> VCodeBlockHighlightHelper::blocksInVisibleOrder() const
+{
+    QVector<int> order(m_codeBlocks.size());
+    for (int i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+
+    int firstVisible = m_highlighter->getFirstVisibleBlock();
+    int lastVisible = m_highlighter->getLastVisibleBlock();
+    if (firstVisible < 0 || lastVisible < firstVisible) {
+        return order;
+    }
+
+    // Distance in blocks to the viewport. 0 if visible.
+    auto distance = [this, firstVisible, lastVisible](int p_idx) {
+        const VCodeBlock &block = m_codeBlocks[p_idx];
+        if (block.m_endBlock < firstVisible) {
+            return firstVisible - block.m_endBlock;
+        } else if (block.m_startBlock > lastVisible) {
+            return block.m_startBlock - lastVisible;
+        }
+
+        return 0;
+    };
+
+    std::stable_sort(order.begin(), order.end(), [&distance](int p_a, int p_b) {
+        return distance(p_a) < distance(p_b);
+    });
+
+    return order;
+}
+
+void VCodeBlockHighlightHelper::handleTextHighlightResult(const QJsonArray &p_classes,
+                                                          const QJsonArray &p_triples,
                                                           int p_id,
                                                           int p_timeStamp)
 {
@@ -95,124 +170,115 @@ void VCodeBlockHighlightHelper::handleTextHighlightResult(const QString &p_html,
     if (curStamp != p_timeStamp) {
         return;
     }
-    parseHighlightResult(p_timeStamp, p_id, p_html);
+
+    if (m_pendingWebResults > 0) {
+        --m_pendingWebResults;
+    }
+
+    if (p_id < 0 || p_id >= m_codeBlocks.size()) {
+        return;
+    }
+
+    const VCodeBlock &block = m_codeBlocks.at(p_id);
+    QVector<HLUnitPos> units = parseHighlightResult(block.m_text, p_classes, p_triples);
+
+    // Add it to cache.
+    g_codeBlockCache->insert(cacheKey(block, false), units);
+
+    updateHighlightResults(block.m_startPos, units);
 }
 
-static void revertEscapedHtml(QString &p_html)
+VCodeBlockCacheKey VCodeBlockHighlightHelper::cacheKey(const VCodeBlock &p_block, bool p_native)
 {
-    p_html.replace("&gt;", ">").replace("&lt;", "<").replace("&amp;", "&");
+    return VCodeBlockCacheKey(p_block.m_text,
+                              p_block.m_lang,
+                              p_native ? VCodeBlockTokenizer::c_version : c_webHighlighterVersion);
 }
 
-// Search @p_tokenStr in @p_text from p_index. Spaces after `\n` will not make
-// a difference in the match. The matched range will be returned as
-// [@p_start, @p_end]. Update @p_index to @p_end + 1.
-// Set @p_start and @p_end to -1 to indicate mismatch.
-static void matchTokenRelaxed(const QString &p_text, const QString &p_tokenStr,
-                              int &p_index, int &p_start, int &p_end)
+void VCodeBlockHighlightHelper::handleTokenizeResult(const QVector<HLUnitPos> &p_units,
+                                                     int p_id,
+                                                     int p_timeStamp)
 {
-    QString regStr = QRegExp::escape(p_tokenStr);
-    // Do not replace the ending '\n'.
-    regStr.replace(QRegExp("\n(?!$)"), "\\s+");
-    QRegExp regExp(regStr);
-    p_start = p_text.indexOf(regExp, p_index);
-    if (p_start == -1) {
-        p_end = -1;
+    int curStamp = m_timeStamp.load();
+    // Abandon obsolete result.
+    if (curStamp != p_timeStamp) {
         return;
     }
 
-    p_end = p_start + regExp.matchedLength() - 1;
-    p_index = p_end + 1;
+    const VCodeBlock &block = m_codeBlocks.at(p_id);
+    g_codeBlockCache->insert(cacheKey(block, true), p_units);
+    updateHighlightResults(block.m_startPos, p_units);
 }
 
 // For now, we could only handle code blocks outside the list.
-void VCodeBlockHighlightHelper::parseHighlightResult(int p_timeStamp,
-                                                     int p_idx,
-                                                     const QString &p_html)
+QVector<HLUnitPos> VCodeBlockHighlightHelper::parseHighlightResult(const QString &p_text,
+                                                                   const QJsonArray &p_classes,
+                                                                   const QJsonArray &p_triples) const
 {
-    const VCodeBlock &block = m_codeBlocks.at(p_idx);
-    int startPos = block.m_startPos;
-    QString text = block.m_text;
-
-    QVector<HLUnitPos> hlUnits;
-
-    bool failed = true;
+    QVector<HLUnitPos> units;
 
-    QXmlStreamReader xml(p_html);
+    QVector<QString> classes;
+    classes.reserve(p_classes.size());
+    for (auto const &cls : p_classes) {
+        classes.append(cls.toString());
+    }
 
-    // Must have a fenced line at the front.
-    // textIndex is the start index in the code block text to search for.
-    int textIndex = text.indexOf('\n');
-    if (textIndex == -1) {
-        goto exit;
+    // The web side highlights the unindented text, in which each line
+    // lose @removed[i] leading spaces at @unindentedPos[i].
+    QVector<int> unindentedPos;
+    QVector<int> removed;
+    int nrSpaces = 0;
+    while (nrSpaces < p_text.size() && p_text[nrSpaces] != '\n' && p_text[nrSpaces].isSpace()) {
+        ++nrSpaces;
     }
-    ++textIndex;
 
-    if (xml.readNextStartElement()) {
-        if (xml.name() != "pre") {
-            goto exit;
+    int total = 0;
+    for (int pos = 0; pos < p_text.size();) {
+        int idx = 0;
+        while (idx < nrSpaces
+               && pos + idx < p_text.size()
+               && p_text[pos + idx] != '\n'
+               && p_text[pos + idx].isSpace()) {
+            ++idx;
         }
 
-        if (!xml.readNextStartElement()) {
-            goto exit;
-        }
+        total += idx;
+        unindentedPos.append(pos + idx - total);
+        removed.append(total);
 
-        if (xml.name() != "code") {
-            goto exit;
+        int next = p_text.indexOf('\n', pos);
+        if (next == -1) {
+            break;
         }
 
-        while (xml.readNext()) {
-            if (xml.isCharacters()) {
-                // Revert the HTML escape to match.
-                QString tokenStr = xml.text().toString();
-                revertEscapedHtml(tokenStr);
-
-                int start, end;
-                matchTokenRelaxed(text, tokenStr, textIndex, start, end);
-                if (start == -1) {
-                    failed = true;
-                    goto exit;
-                }
-            } else if (xml.isStartElement()) {
-                if (xml.name() != "span") {
-                    failed = true;
-                    goto exit;
-                }
-                if (!parseSpanElement(xml, text, textIndex, hlUnits)) {
-                    failed = true;
-                    goto exit;
-                }
-            } else if (xml.isEndElement()) {
-                if (xml.name() != "code" && xml.name() != "pre") {
-                    failed = true;
-                } else {
-                    failed = false;
-                }
-                goto exit;
-            } else {
-                failed = true;
-                goto exit;
-            }
-        }
+        pos = next + 1;
     }
 
-exit:
-    // Pass result back to highlighter.
-    int curStamp = m_timeStamp.load();
-    // Abandon obsolete result.
-    if (curStamp != p_timeStamp) {
-        return;
-    }
+    auto mapOffset = [&unindentedPos, &removed](int p_offset) {
+        auto it = std::upper_bound(unindentedPos.begin(), unindentedPos.end(), p_offset);
+        int line = qMax((int)(it - unindentedPos.begin()) - 1, 0);
+        return p_offset + removed[line];
+    };
+
+    int nrTriples = p_triples.size() / 3;
+    units.reserve(nrTriples);
+    for (int i = 0; i < nrTriples; ++i) {
+        int offset = p_triples[3 * i].toInt();
+        int length = p_triples[3 * i + 1].toInt();
+        int classId = p_triples[3 * i + 2].toInt(-1);
+        if (offset < 0 || length <= 0 || classId < 0 || classId >= classes.size()) {
+            qWarning() << "invalid code block highlight result" << offset << length << classId;
+            continue;
+        }
 
-    if (xml.hasError() || failed) {
-        qWarning() << "fail to parse highlighted result"
-                   << "stamp:" << p_timeStamp << "index:" << p_idx << p_html;
-        hlUnits.clear();
+        int start = mapOffset(offset);
+        int end = qMin(mapOffset(offset + length), p_text.size());
+        if (start < end) {
+            units.append(HLUnitPos(start, end - start, classes[classId]));
+        }
     }
 
-    // Add it to cache.
-    addToHighlightCache(text, p_timeStamp, hlUnits);
-
-    updateHighlightResults(startPos, hlUnits);
+    return units;
 }
 
 void VCodeBlockHighlightHelper::updateHighlightResults(int p_startPos,
@@ -225,68 +291,3 @@ void VCodeBlockHighlightHelper::updateHighlightResults(int p_startPos,
     // We need to call this function anyway to trigger the rehighlight.
     m_highlighter->setCodeBlockHighlights(p_units);
 }
-
-bool VCodeBlockHighlightHelper::parseSpanElement(QXmlStreamReader &p_xml,
-                                                 const QString &p_text,
-                                                 int &p_index,
-                                                 QVector<HLUnitPos> &p_units)
-{
-    int unitStart = p_index;
-    QString style = p_xml.attributes().value("class").toString();
-
-    while (p_xml.readNext()) {
-        if (p_xml.isCharacters()) {
-            // Revert the HTML escape to match.
-            QString tokenStr = p_xml.text().toString();
-            revertEscapedHtml(tokenStr);
-
-            int start, end;
-            matchTokenRelaxed(p_text, tokenStr, p_index, start, end);
-            if (start == -1) {
-                return false;
-            }
-        } else if (p_xml.isStartElement()) {
-            if (p_xml.name() != "span") {
-                return false;
-            }
-
-            // Sub-span.
-            if (!parseSpanElement(p_xml, p_text, p_index, p_units)) {
-                return false;
-            }
-        } else if (p_xml.isEndElement()) {
-            if (p_xml.name() != "span") {
-                return false;
-            }
-
-            // Got a complete span. Use relative position here.
-            HLUnitPos unit(unitStart, p_index - unitStart, style);
-            p_units.append(unit);
-            return true;
-        } else {
-            return false;
-        }
-    }
-    return false;
-}
-
-void VCodeBlockHighlightHelper::addToHighlightCache(const QString &p_text,
-                                                    int p_timeStamp,
-                                                    const QVector<HLUnitPos> &p_units)
-{
-    const int c_maxEntries = 100;
-    const int c_maxTimeStampSpan = 3;
-    if (m_cache.size() >= c_maxEntries) {
-        // Remove the oldest one.
-        int ts = p_timeStamp - c_maxTimeStampSpan;
-        for (auto it = m_cache.begin(); it != m_cache.end();) {
-            if (it.value().m_timeStamp < ts) {
-                it = m_cache.erase(it);
-            } else {
-                ++it;
-            }
-        }
-    }
-
-    m_cache.insert(p_text, HLResult(p_timeStamp, p_units));
-}
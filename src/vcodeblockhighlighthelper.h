@@ -4,11 +4,17 @@
 #include <QObject>
 #include <QVector>
 #include <QAtomicInteger>
-#include <QXmlStreamReader>
-#include <QHash>
+#include <QJsonArray>
 #include "vconfigmanager.h"
 
 class VDocument;
+class VCodeBlockHighlightCache;
+struct VCodeBlockCacheKey;
+class VCodeBlockTokenizerWorker;
+
+QT_BEGIN_NAMESPACE
+class QThread;
+QT_END_NAMESPACE
 
 class VCodeBlockHighlightHelper : public QObject
 {
@@ -17,35 +23,28 @@ public:
     VCodeBlockHighlightHelper(HGMarkdownHighlighter *p_highlighter,
                               VDocument *p_vdoc, MarkdownConverterType p_type);
 
+    ~VCodeBlockHighlightHelper();
+
+signals:
+    // Internal use to queue a code block in the tokenizer thread.
+    void requestTokenize(const QString &p_text, const QString &p_lang, int p_id, int p_timeStamp);
+
 private slots:
     void handleCodeBlocksUpdated(const QVector<VCodeBlock> &p_codeBlocks);
 
-    void handleTextHighlightResult(const QString &p_html, int p_id, int p_timeStamp);
+    void handleTextHighlightResult(const QJsonArray &p_classes,
+                                   const QJsonArray &p_triples,
+                                   int p_id,
+                                   int p_timeStamp);
+
+    void handleTokenizeResult(const QVector<HLUnitPos> &p_units, int p_id, int p_timeStamp);
 
 private:
-    struct HLResult
-    {
-        HLResult() : m_timeStamp(-1)
-        {
-        }
-
-        HLResult(int p_timeStamp, const QVector<HLUnitPos> &p_units)
-            : m_timeStamp(p_timeStamp), m_units(p_units)
-        {
-        }
-
-        int m_timeStamp;
-        QVector<HLUnitPos> m_units;
-    };
-
-    void parseHighlightResult(int p_timeStamp, int p_idx, const QString &p_html);
-
-    // @p_text: the raw text of the code block;
-    // @p_index: the start index of the span element within @p_text;
-    // @p_units: all the highlight units of this code block;
-    bool parseSpanElement(QXmlStreamReader &p_xml,
-                          const QString &p_text, int &p_index,
-                          QVector<HLUnitPos> &p_units);
+    // Convert the (offset, length, class-id) triples of the unindented text
+    // of @p_text into highlight units within @p_text.
+    QVector<HLUnitPos> parseHighlightResult(const QString &p_text,
+                                            const QJsonArray &p_classes,
+                                            const QJsonArray &p_triples) const;
 
     // @p_text: text of fenced code block.
     // Get the indent level of the first line (fence) and unindent the whole block
@@ -56,9 +55,13 @@ private:
 
     void updateHighlightResults(int p_startPos, QVector<HLUnitPos> p_units);
 
-    void addToHighlightCache(const QString &p_text,
-                             int p_timeStamp,
-                             const QVector<HLUnitPos> &p_units);
+    // Indexes of m_codeBlocks sorted by the distance to the viewport, so those
+    // visible will be highlighted first.
+    QVector<int> blocksInVisibleOrder() const;
+
+    // Key of @p_block in the cache.
+    // @p_native: whether it is highlighted natively.
+    static VCodeBlockCacheKey cacheKey(const VCodeBlock &p_block, bool p_native);
 
     HGMarkdownHighlighter *m_highlighter;
     VDocument *m_vdocument;
@@ -66,9 +69,13 @@ private:
     QAtomicInteger<int> m_timeStamp;
     QVector<VCodeBlock> m_codeBlocks;
 
-    // Cache for highlight result, using the code block text as key.
-    // The HLResult has relative position only.
-    QHash<QString, HLResult> m_cache;
+    // Number of results of the batch in the web side not received yet.
+    // The batch is finished once it reaches 0.
+    int m_pendingWebResults;
+
+    // Highlight code blocks of common languages natively.
+    QThread *m_tokenizerThread;
+    VCodeBlockTokenizerWorker *m_tokenizer;
 };
 
 #endif // VCODEBLOCKHIGHLIGHTHELPER_H
@@ -0,0 +1,872 @@
+#include "vcodeblocktokenizer.h"
+
+#include <QHash>
+#include <QSet>
+#include <QStringList>
+
+namespace
+{
+enum class Language
+{
+    None = 0,
+    C,
+    Python,
+    JavaScript,
+    Shell,
+    Json,
+    Yaml,
+    Sql,
+    Go,
+    Rust
+};
+
+// Lexical rules of one language.
+struct LanguageDef
+{
+    LanguageDef()
+        : m_nestedBlockComment(false),
+          m_tripleQuotes(false),
+          m_doubledQuoteEscape(false),
+          m_commentAfterSpace(false),
+          m_caseInsensitive(false),
+          m_preprocessor(false),
+          m_decorators(false),
+          m_attributes(false),
+          m_macros(false),
+          m_lifetimes(false),
+          m_dollarVariables(false),
+          m_jsonKeys(false),
+          m_yamlKeys(false)
+    {
+    }
+
+    QSet<QString> m_keywords;
+
+    QSet<QString> m_types;
+
+    QSet<QString> m_literals;
+
+    QSet<QString> m_builtins;
+
+    // Keywords followed by a name to define, such as "class" and "def".
+    QSet<QString> m_titleKeywords;
+
+    // Prefixes of strings, such as r"" in Python.
+    QSet<QString> m_stringPrefixes;
+
+    QStringList m_lineComments;
+
+    QString m_blockCommentStart;
+
+    QString m_blockCommentEnd;
+
+    bool m_nestedBlockComment;
+
+    // Characters to quote a string.
+    QString m_quotes;
+
+    // Quotes of strings which could span multiple lines.
+    QString m_multiLineQuotes;
+
+    // Quotes of strings without escape sequences.
+    QString m_rawQuotes;
+
+    // """ and ''' strings.
+    bool m_tripleQuotes;
+
+    // 'it''s' in SQL.
+    bool m_doubledQuoteEscape;
+
+    // Line comments must follow a space, such as # in Shell.
+    bool m_commentAfterSpace;
+
+    bool m_caseInsensitive;
+
+    // #include and so on.
+    bool m_preprocessor;
+
+    // @decorator in Python.
+    bool m_decorators;
+
+    // #[attribute] in Rust.
+    bool m_attributes;
+
+    // macro! in Rust.
+    bool m_macros;
+
+    // 'a in Rust.
+    bool m_lifetimes;
+
+    // $VAR in Shell.
+    bool m_dollarVariables;
+
+    // "key": in JSON.
+    bool m_jsonKeys;
+
+    // key: in YAML.
+    bool m_yamlKeys;
+};
+}
+
+static QSet<QString> wordSet(const char *p_words)
+{
+    return QString(p_words).split(' ', QString::SkipEmptyParts).toSet();
+}
+
+static Language languageFromName(const QString &p_lang)
+{
+    static const QHash<QString, Language> langs = []() {
+        QHash<QString, Language> res;
+        const char *cNames[] = {"c", "cpp", "c++", "cc", "cxx", "h", "hpp", "hxx"};
+        for (auto name : cNames) {
+            res.insert(name, Language::C);
+        }
+
+        res.insert("python", Language::Python);
+        res.insert("py", Language::Python);
+        res.insert("python3", Language::Python);
+
+        res.insert("javascript", Language::JavaScript);
+        res.insert("js", Language::JavaScript);
+        res.insert("jsx", Language::JavaScript);
+
+        const char *shellNames[] = {"bash", "sh", "shell", "zsh"};
+        for (auto name : shellNames) {
+            res.insert(name, Language::Shell);
+        }
+
+        res.insert("json", Language::Json);
+
+        res.insert("yaml", Language::Yaml);
+        res.insert("yml", Language::Yaml);
+
+        const char *sqlNames[] = {"sql", "mysql", "pgsql", "postgresql", "sqlite"};
+        for (auto name : sqlNames) {
+            res.insert(name, Language::Sql);
+        }
+
+        res.insert("go", Language::Go);
+        res.insert("golang", Language::Go);
+
+        res.insert("rust", Language::Rust);
+        res.insert("rs", Language::Rust);
+        return res;
+    }();
+
+    return langs.value(p_lang.toLower(), Language::None);
+}
+
+static LanguageDef createLanguageDef(Language p_lang)
+{
+    LanguageDef def;
+    switch (p_lang) {
+    case Language::C:
+        def.m_keywords = wordSet("auto break case catch class const constexpr const_cast continue "
+                                 "decltype default delete do dynamic_cast else enum explicit export "
+                                 "extern final for friend goto if inline mutable namespace new "
+                                 "noexcept operator override private protected public register "
+                                 "reinterpret_cast return sizeof static static_assert static_cast "
+                                 "struct switch template this thread_local throw try typedef "
+                                 "typeid typename union using virtual volatile while");
+        def.m_types = wordSet("bool char char16_t char32_t double float int long short signed "
+                              "unsigned void wchar_t size_t ssize_t ptrdiff_t int8_t int16_t "
+                              "int32_t int64_t uint8_t uint16_t uint32_t uint64_t");
+        def.m_literals = wordSet("true false nullptr NULL");
+        def.m_builtins = wordSet("std string vector map set cout cin cerr endl printf scanf "
+                                 "malloc free memcpy memset strlen");
+        def.m_titleKeywords = wordSet("class struct enum union namespace");
+        def.m_stringPrefixes = wordSet("L u U u8 R");
+        def.m_lineComments << "//";
+        def.m_blockCommentStart = "/*";
+        def.m_blockCommentEnd = "*/";
+        def.m_quotes = "\"'";
+        def.m_preprocessor = true;
+        break;
+
+    case Language::Python:
+        def.m_keywords = wordSet("and as assert async await break class continue def del elif "
+                                 "else except exec finally for from global if import in is "
+                                 "lambda nonlocal not or pass print raise return try while with "
+                                 "yield");
+        def.m_literals = wordSet("True False None Ellipsis NotImplemented");
+        def.m_builtins = wordSet("abs all any bin bool bytes callable chr dict dir divmod "
+                                 "enumerate filter float format getattr hasattr hash hex id input "
+                                 "int isinstance issubclass iter len list map max min next object "
+                                 "oct open ord pow range repr reversed round set setattr slice "
+                                 "sorted str sum super tuple type zip");
+        def.m_titleKeywords = wordSet("def class");
+        def.m_stringPrefixes = wordSet("r u b f br rb fr rf R U B F BR RB FR RF Rb rB Br bR");
+        def.m_lineComments << "#";
+        def.m_quotes = "\"'";
+        def.m_tripleQuotes = true;
+        def.m_decorators = true;
+        break;
+
+    case Language::JavaScript:
+        def.m_keywords = wordSet("as async await break case catch class const continue debugger "
+                                 "default delete do else export extends finally for from function "
+                                 "get if import in instanceof let new of return set static super "
+                                 "switch this throw try typeof var void while with yield");
+        def.m_literals = wordSet("true false null undefined NaN Infinity");
+        def.m_builtins = wordSet("Array Boolean Date Error JSON Map Math Number Object Promise "
+                                 "RegExp Set String Symbol console document module require "
+                                 "window");
+        def.m_titleKeywords = wordSet("function class");
+        def.m_lineComments << "//";
+        def.m_blockCommentStart = "/*";
+        def.m_blockCommentEnd = "*/";
+        def.m_quotes = "\"'`";
+        def.m_multiLineQuotes = "`";
+        break;
+
+    case Language::Shell:
+        def.m_keywords = wordSet("if then else elif fi for while until in do done case esac "
+                                 "function select return break continue local export declare "
+                                 "readonly");
+        def.m_builtins = wordSet("alias bg cd echo eval exec exit fg getopts hash jobs kill "
+                                 "printf pwd read set shift source test trap type ulimit umask "
+                                 "unalias unset wait");
+        def.m_titleKeywords = wordSet("function");
+        def.m_lineComments << "#";
+        def.m_quotes = "\"'";
+        def.m_multiLineQuotes = "\"'";
+        def.m_rawQuotes = "'";
+        def.m_commentAfterSpace = true;
+        def.m_dollarVariables = true;
+        break;
+
+    case Language::Json:
+        def.m_literals = wordSet("true false null");
+        def.m_quotes = "\"";
+        def.m_jsonKeys = true;
+        break;
+
+    case Language::Yaml:
+        def.m_literals = wordSet("true false null yes no on off True False Null Yes No On Off "
+                                 "TRUE FALSE NULL YES NO ON OFF");
+        def.m_lineComments << "#";
+        def.m_quotes = "\"'";
+        def.m_commentAfterSpace = true;
+        def.m_jsonKeys = true;
+        def.m_yamlKeys = true;
+        break;
+
+    case Language::Sql:
+        def.m_keywords = wordSet("add all alter and as asc begin between by cascade case check "
+                                 "column commit constraint create cross database default delete "
+                                 "desc distinct drop else end except exists foreign from full "
+                                 "grant group having if in index inner insert intersect into is "
+                                 "join key left like limit not offset on or order outer primary "
+                                 "references replace returning revoke right rollback select set "
+                                 "table then transaction trigger truncate union unique update "
+                                 "using values view when where with");
+        def.m_types = wordSet("bigint binary bit blob bool boolean char date datetime decimal "
+                              "double float int integer interval json money numeric real serial "
+                              "smallint text time timestamp tinyint uuid varbinary varchar");
+        def.m_literals = wordSet("true false null");
+        def.m_builtins = wordSet("avg coalesce count max min now sum");
+        def.m_lineComments << "--";
+        def.m_blockCommentStart = "/*";
+        def.m_blockCommentEnd = "*/";
+        def.m_quotes = "'\"`";
+        def.m_multiLineQuotes = "'";
+        def.m_doubledQuoteEscape = true;
+        def.m_caseInsensitive = true;
+        break;
+
+    case Language::Go:
+        def.m_keywords = wordSet("break case chan const continue default defer else fallthrough "
+                                 "for func go goto if import interface map package range return "
+                                 "select struct switch type var");
+        def.m_types = wordSet("bool byte complex64 complex128 error float32 float64 int int8 "
+                              "int16 int32 int64 rune string uint uint8 uint16 uint32 uint64 "
+                              "uintptr");
+        def.m_literals = wordSet("true false nil iota");
+        def.m_builtins = wordSet("append cap close complex copy delete imag len make new panic "
+                                 "print println real recover");
+        def.m_titleKeywords = wordSet("func type");
+        def.m_lineComments << "//";
+        def.m_blockCommentStart = "/*";
+        def.m_blockCommentEnd = "*/";
+        def.m_quotes = "\"'`";
+        def.m_multiLineQuotes = "`";
+        def.m_rawQuotes = "`";
+        break;
+
+    case Language::Rust:
+        def.m_keywords = wordSet("as async await break const continue crate dyn else enum "
+                                 "extern fn for if impl in let loop match mod move mut pub ref "
+                                 "return self Self static struct super trait type unsafe use "
+                                 "where while");
+        def.m_types = wordSet("i8 i16 i32 i64 i128 isize u8 u16 u32 u64 u128 usize f32 f64 "
+                              "bool char str String Vec Option Result Box");
+        def.m_literals = wordSet("true false Some None Ok Err");
+        def.m_titleKeywords = wordSet("fn struct enum trait mod type");
+        def.m_stringPrefixes = wordSet("b r br");
+        def.m_lineComments << "//";
+        def.m_blockCommentStart = "/*";
+        def.m_blockCommentEnd = "*/";
+        def.m_nestedBlockComment = true;
+        def.m_quotes = "\"";
+        def.m_multiLineQuotes = "\"";
+        def.m_attributes = true;
+        def.m_macros = true;
+        def.m_lifetimes = true;
+        break;
+
+    default:
+        break;
+    }
+
+    return def;
+}
+
+static const LanguageDef &languageDef(Language p_lang)
+{
+    static const QVector<LanguageDef> defs = []() {
+        QVector<LanguageDef> res;
+        for (int i = 0; i <= (int)Language::Rust; ++i) {
+            res.append(createLanguageDef((Language)i));
+        }
+
+        return res;
+    }();
+
+    return defs[(int)p_lang];
+}
+
+namespace
+{
+// Scan the code of one code block and collect the highlight units.
+class Tokenizer
+{
+public:
+    Tokenizer(const QString &p_text,
+              int p_start,
+              int p_end,
+              const LanguageDef &p_def,
+              QVector<HLUnitPos> &p_units)
+        : m_text(p_text),
+          m_start(p_start),
+          m_end(p_end),
+          m_def(p_def),
+          m_units(p_units),
+          m_expectTitle(false)
+    {
+    }
+
+    void run()
+    {
+        int i = m_start;
+        bool lineStart = true;
+        while (i < m_end) {
+            QChar ch = m_text[i];
+            if (ch == '\n') {
+                lineStart = true;
+                m_expectTitle = false;
+                ++i;
+                continue;
+            } else if (ch.isSpace()) {
+                ++i;
+                continue;
+            }
+
+            int next = -1;
+            if (lineStart) {
+                lineStart = false;
+                next = scanLineStart(i);
+            }
+
+            if (next == -1) {
+                next = scanComment(i);
+            }
+
+            if (next == -1) {
+                next = scanMeta(i);
+            }
+
+            if (next == -1) {
+                next = scanString(i, i);
+            }
+
+            if (next == -1) {
+                next = scanNumber(i);
+            }
+
+            if (next == -1) {
+                next = scanWord(i);
+            }
+
+            if (next == -1) {
+                next = scanVariable(i);
+            }
+
+            if (next == -1) {
+                // Punctuation.
+                m_expectTitle = false;
+                next = i + 1;
+            }
+
+            i = next;
+        }
+    }
+
+private:
+    void addUnit(int p_start, int p_end, const char *p_style)
+    {
+        if (p_end > p_start) {
+            m_units.append(HLUnitPos(p_start, p_end - p_start, QString(p_style)));
+        }
+    }
+
+    QChar at(int p_idx) const
+    {
+        return (p_idx >= m_start && p_idx < m_end) ? m_text[p_idx] : QChar();
+    }
+
+    bool matchAt(int p_idx, const QString &p_str) const
+    {
+        return !p_str.isEmpty()
+               && p_idx + p_str.size() <= m_end
+               && m_text.midRef(p_idx, p_str.size()) == p_str;
+    }
+
+    static bool isWordChar(QChar p_ch)
+    {
+        return p_ch.isLetterOrNumber() || p_ch == '_';
+    }
+
+    int lineEnd(int p_idx) const
+    {
+        int idx = m_text.indexOf('\n', p_idx);
+        return (idx == -1 || idx > m_end) ? m_end : idx;
+    }
+
+    // Skip spaces within current line.
+    int skipSpaces(int p_idx) const
+    {
+        while (p_idx < m_end && m_text[p_idx] != '\n' && m_text[p_idx].isSpace()) {
+            ++p_idx;
+        }
+
+        return p_idx;
+    }
+
+    // @p_idx is the first non-space character of a line.
+    int scanLineStart(int p_idx)
+    {
+        if (m_def.m_yamlKeys) {
+            // Document markers.
+            if (p_idx == m_start || m_text[p_idx - 1] == '\n') {
+                if (matchAt(p_idx, "---") || matchAt(p_idx, "...")) {
+                    int end = lineEnd(p_idx);
+                    addUnit(p_idx, end, "hljs-meta");
+                    return end;
+                }
+            }
+
+            // Items of a sequence.
+            int keyStart = p_idx;
+            while (matchAt(keyStart, "- ")) {
+                keyStart = skipSpaces(keyStart + 2);
+            }
+
+            QChar ch = at(keyStart);
+            if (ch.isNull() || ch == '#' || ch == '"' || ch == '\''
+                || ch == '{' || ch == '[') {
+                return keyStart > p_idx ? keyStart : -1;
+            }
+
+            int end = lineEnd(keyStart);
+            for (int j = keyStart; j < end; ++j) {
+                ch = m_text[j];
+                if (ch == '#') {
+                    break;
+                } else if (ch == ':' && (j + 1 == end || at(j + 1).isSpace())) {
+                    int keyEnd = j;
+                    while (keyEnd > keyStart && m_text[keyEnd - 1].isSpace()) {
+                        --keyEnd;
+                    }
+
+                    addUnit(keyStart, keyEnd, "hljs-attr");
+                    return j + 1;
+                }
+            }
+
+            return keyStart > p_idx ? keyStart : -1;
+        }
+
+        if (m_def.m_preprocessor && m_text[p_idx] == '#') {
+            // Directives may continue with a trailing backslash.
+            int end = lineEnd(p_idx);
+            while (end < m_end && end > p_idx && m_text[end - 1] == '\\') {
+                end = lineEnd(end + 1);
+            }
+
+            addUnit(p_idx, end, "hljs-meta");
+            return end;
+        }
+
+        return -1;
+    }
+
+    int scanComment(int p_idx)
+    {
+        if (matchAt(p_idx, m_def.m_blockCommentStart)) {
+            const QString &startStr = m_def.m_blockCommentStart;
+            const QString &endStr = m_def.m_blockCommentEnd;
+            int depth = 1;
+            int j = p_idx + startStr.size();
+            while (j < m_end) {
+                if (matchAt(j, endStr)) {
+                    j += endStr.size();
+                    if (--depth == 0) {
+                        break;
+                    }
+                } else if (m_def.m_nestedBlockComment && matchAt(j, startStr)) {
+                    j += startStr.size();
+                    ++depth;
+                } else {
+                    ++j;
+                }
+            }
+
+            addUnit(p_idx, j, "hljs-comment");
+            return j;
+        }
+
+        for (auto const &lc : m_def.m_lineComments) {
+            if (matchAt(p_idx, lc)) {
+                if (m_def.m_commentAfterSpace
+                    && p_idx > m_start
+                    && !m_text[p_idx - 1].isSpace()) {
+                    continue;
+                }
+
+                int end = lineEnd(p_idx);
+                addUnit(p_idx, end, "hljs-comment");
+                return end;
+            }
+        }
+
+        return -1;
+    }
+
+    int scanMeta(int p_idx)
+    {
+        QChar ch = m_text[p_idx];
+        if (m_def.m_decorators && ch == '@' && (at(p_idx + 1).isLetter() || at(p_idx + 1) == '_')) {
+            int j = p_idx + 1;
+            while (isWordChar(at(j)) || at(j) == '.') {
+                ++j;
+            }
+
+            addUnit(p_idx, j, "hljs-meta");
+            return j;
+        }
+
+        if (m_def.m_attributes && ch == '#' && (at(p_idx + 1) == '[' || matchAt(p_idx + 1, "!["))) {
+            int j = m_text.indexOf('[', p_idx) + 1;
+            int depth = 1;
+            while (j < m_end && depth > 0) {
+                if (m_text[j] == '[') {
+                    ++depth;
+                } else if (m_text[j] == ']') {
+                    --depth;
+                }
+
+                ++j;
+            }
+
+            addUnit(p_idx, j, "hljs-meta");
+            return j;
+        }
+
+        return -1;
+    }
+
+    // Scan a string whose quote is at @p_idx and which starts at @p_start,
+    // including its prefix.
+    int scanString(int p_idx, int p_start)
+    {
+        QChar quote = m_text[p_idx];
+        if (m_def.m_lifetimes && quote == '\'') {
+            return scanCharOrLifetime(p_idx);
+        }
+
+        if (!m_def.m_quotes.contains(quote)) {
+            return -1;
+        }
+
+        int j = p_idx + 1;
+        QString triple(3, quote);
+        if (m_def.m_tripleQuotes && matchAt(p_idx, triple)) {
+            j = m_text.indexOf(triple, p_idx + 3);
+            j = (j == -1 || j + 3 > m_end) ? m_end : j + 3;
+        } else {
+            bool multiLine = m_def.m_multiLineQuotes.contains(quote);
+            bool escape = !m_def.m_rawQuotes.contains(quote);
+            while (j < m_end) {
+                QChar ch = m_text[j];
+                if (ch == '\\' && escape) {
+                    j += 2;
+                } else if (ch == quote) {
+                    ++j;
+                    if (m_def.m_doubledQuoteEscape && at(j) == quote) {
+                        ++j;
+                        continue;
+                    }
+
+                    break;
+                } else if (ch == '\n' && !multiLine) {
+                    break;
+                } else {
+                    ++j;
+                }
+            }
+
+            j = qMin(j, m_end);
+        }
+
+        if (m_def.m_jsonKeys && at(skipSpaces(j)) == ':') {
+            addUnit(p_start, j, "hljs-attr");
+        } else {
+            addUnit(p_start, j, "hljs-string");
+        }
+
+        m_expectTitle = false;
+        return j;
+    }
+
+    // Rust raw strings r#"..."#.
+    int scanRawString(int p_idx, int p_start)
+    {
+        int j = p_idx;
+        while (at(j) == '#') {
+            ++j;
+        }
+
+        if (at(j) != '"') {
+            return -1;
+        }
+
+        QString endStr = "\"" + QString(j - p_idx, '#');
+        int end = m_text.indexOf(endStr, j + 1);
+        end = (end == -1 || end + endStr.size() > m_end) ? m_end : end + endStr.size();
+        addUnit(p_start, end, "hljs-string");
+        return end;
+    }
+
+    int scanCharOrLifetime(int p_idx)
+    {
+        int j = -1;
+        if (at(p_idx + 1) == '\\') {
+            j = m_text.indexOf('\'', p_idx + 3);
+            if (j == -1 || j >= lineEnd(p_idx)) {
+                j = -1;
+            }
+        } else if (at(p_idx + 2) == '\'') {
+            j = p_idx + 2;
+        }
+
+        if (j != -1) {
+            addUnit(p_idx, j + 1, "hljs-string");
+            return j + 1;
+        }
+
+        j = p_idx + 1;
+        while (isWordChar(at(j))) {
+            ++j;
+        }
+
+        addUnit(p_idx, j, "hljs-symbol");
+        return j;
+    }
+
+    int scanNumber(int p_idx)
+    {
+        QChar ch = m_text[p_idx];
+        if (!ch.isDigit() && !(ch == '.' && at(p_idx + 1).isDigit())) {
+            return -1;
+        }
+
+        bool hex = ch == '0' && (at(p_idx + 1) == 'x' || at(p_idx + 1) == 'X');
+        int j = p_idx + 1;
+        while (j < m_end) {
+            QChar c = m_text[j];
+            if (c == '.') {
+                // Ranges like 0..10.
+                if (at(j + 1) == '.') {
+                    break;
+                }
+            } else if (c == '+' || c == '-') {
+                QChar prev = m_text[j - 1];
+                if (hex || (prev != 'e' && prev != 'E')) {
+                    break;
+                }
+            } else if (!isWordChar(c)) {
+                break;
+            }
+
+            ++j;
+        }
+
+        addUnit(p_idx, j, "hljs-number");
+        m_expectTitle = false;
+        return j;
+    }
+
+    int scanWord(int p_idx)
+    {
+        QChar ch = m_text[p_idx];
+        if (!ch.isLetter() && ch != '_') {
+            return -1;
+        }
+
+        int j = p_idx + 1;
+        while (isWordChar(at(j))) {
+            ++j;
+        }
+
+        QString word = m_text.mid(p_idx, j - p_idx);
+
+        // Prefixed strings.
+        if (m_def.m_stringPrefixes.contains(word)) {
+            if (m_def.m_lifetimes && word.endsWith('r')) {
+                int end = scanRawString(j, p_idx);
+                if (end != -1) {
+                    return end;
+                }
+            }
+
+            QChar next = at(j);
+            if (!next.isNull() && m_def.m_quotes.contains(next)) {
+                return scanString(j, p_idx);
+            }
+        }
+
+        if (m_def.m_macros && at(j) == '!' && at(j + 1) != '=') {
+            addUnit(p_idx, j + 1, "hljs-built_in");
+            m_expectTitle = false;
+            return j + 1;
+        }
+
+        if (m_def.m_caseInsensitive) {
+            word = word.toLower();
+        }
+
+        if (m_def.m_keywords.contains(word)) {
+            addUnit(p_idx, j, "hljs-keyword");
+            m_expectTitle = m_def.m_titleKeywords.contains(word);
+            return j;
+        }
+
+        if (m_def.m_literals.contains(word)) {
+            addUnit(p_idx, j, "hljs-literal");
+        } else if (m_def.m_types.contains(word)) {
+            addUnit(p_idx, j, "hljs-type");
+        } else if (m_expectTitle) {
+            addUnit(p_idx, j, "hljs-title");
+        } else if (m_def.m_builtins.contains(word)) {
+            addUnit(p_idx, j, "hljs-built_in");
+        }
+
+        m_expectTitle = false;
+        return j;
+    }
+
+    int scanVariable(int p_idx)
+    {
+        if (!m_def.m_dollarVariables || m_text[p_idx] != '$') {
+            return -1;
+        }
+
+        QChar next = at(p_idx + 1);
+        int j = -1;
+        if (next == '{') {
+            j = m_text.indexOf('}', p_idx + 2);
+            j = (j == -1 || j >= lineEnd(p_idx)) ? -1 : j + 1;
+        } else if (next.isLetter() || next == '_') {
+            j = p_idx + 2;
+            while (isWordChar(at(j))) {
+                ++j;
+            }
+        } else if (next.isDigit() || QString("@#?$!*-").contains(next)) {
+            j = p_idx + 2;
+        }
+
+        if (j == -1) {
+            return -1;
+        }
+
+        addUnit(p_idx, j, "hljs-variable");
+        return j;
+    }
+
+    const QString &m_text;
+
+    // Range [m_start, m_end) of the code to scan.
+    int m_start;
+    int m_end;
+
+    const LanguageDef &m_def;
+
+    QVector<HLUnitPos> &m_units;
+
+    // Whether next word is the name of a definition.
+    bool m_expectTitle;
+};
+}
+
+const quint32 VCodeBlockTokenizer::c_version = 1;
+
+bool VCodeBlockTokenizer::isLanguageSupported(const QString &p_lang)
+{
+    return languageFromName(p_lang) != Language::None;
+}
+
+QVector<HLUnitPos> VCodeBlockTokenizer::tokenize(const QString &p_text, const QString &p_lang)
+{
+    QVector<HLUnitPos> units;
+    Language lang = languageFromName(p_lang);
+    if (lang == Language::None) {
+        return units;
+    }
+
+    // Skip the fences.
+    int start = p_text.indexOf('\n');
+    int end = p_text.lastIndexOf('\n');
+    if (start == -1 || end <= start) {
+        return units;
+    }
+
+    Tokenizer tokenizer(p_text, start + 1, end, languageDef(lang), units);
+    tokenizer.run();
+    return units;
+}
+
+
+VCodeBlockTokenizerWorker::VCodeBlockTokenizerWorker(QObject *p_parent)
+    : QObject(p_parent),
+      m_latestTimeStamp(0)
+{
+}
+
+void VCodeBlockTokenizerWorker::setLatestTimeStamp(int p_timeStamp)
+{
+    m_latestTimeStamp.store(p_timeStamp);
+}
+
+void VCodeBlockTokenizerWorker::tokenize(const QString &p_text,
+                                         const QString &p_lang,
+                                         int p_id,
+                                         int p_timeStamp)
+{
+    // Skip obsolete request.
+    if (p_timeStamp < m_latestTimeStamp.load()) {
+        return;
+    }
+
+    QVector<HLUnitPos> units = VCodeBlockTokenizer::tokenize(p_text, p_lang);
+    emit tokenizeFinished(units, p_id, p_timeStamp);
+}
@@ -0,0 +1,54 @@
+#ifndef VCODEBLOCKTOKENIZER_H
+#define VCODEBLOCKTOKENIZER_H
+
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <QAtomicInteger>
+
+#include "hgmarkdownhighlighter.h"
+
+Q_DECLARE_METATYPE(QVector<HLUnitPos>)
+
+// Native syntax highlighter for fenced code blocks of common languages.
+// Styles are named after the classes of highlight.js, so the code block styles
+// of themes apply to both.
+class VCodeBlockTokenizer
+{
+public:
+    // Version of the rules. Increase it when the results change to make the
+    // cached results obsolete.
+    static const quint32 c_version;
+
+    // Whether code blocks in language @p_lang could be highlighted natively.
+    static bool isLanguageSupported(const QString &p_lang);
+
+    // Highlight fenced code block @p_text (including the fences) in
+    // language @p_lang.
+    // Positions of the returned units are relative to @p_text.
+    static QVector<HLUnitPos> tokenize(const QString &p_text, const QString &p_lang);
+};
+
+
+// Worker living in the code block highlight thread.
+class VCodeBlockTokenizerWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit VCodeBlockTokenizerWorker(QObject *p_parent = nullptr);
+
+    // Thread-safe. Requests with a smaller timestamp are obsolete and will be
+    // skipped.
+    void setLatestTimeStamp(int p_timeStamp);
+
+public slots:
+    void tokenize(const QString &p_text, const QString &p_lang, int p_id, int p_timeStamp);
+
+signals:
+    void tokenizeFinished(const QVector<HLUnitPos> &p_units, int p_id, int p_timeStamp);
+
+private:
+    QAtomicInteger<int> m_latestTimeStamp;
+};
+
+#endif // VCODEBLOCKTOKENIZER_H
@@ -1,6 +1,7 @@
 #include "vconfigmanager.h"
 #include <QDir>
 #include <QFile>
+#include <QSaveFile>
 #include <QString>
 #include <QJsonArray>
 #include <QJsonObject>
@@ -129,9 +130,39 @@ void VConfigManager::initialize()
     m_enableCodeBlockHighlight = getConfigFromSettings("global",
                                                        "enable_code_block_highlight").toBool();
 
+    m_enableNativeCodeBlockHighlight = getConfigFromSettings("global",
+                                                             "enable_native_code_block_highlight").toBool();
+
+    m_codeBlockHighlightCacheSize = getConfigFromSettings("global",
+                                                          "code_block_highlight_cache_size").toInt();
+
+    m_lazyLayoutBlockThreshold = getConfigFromSettings("global",
+                                                       "lazy_layout_block_threshold").toInt();
+
     m_enablePreviewImages = getConfigFromSettings("global",
                                                   "enable_preview_images").toBool();
 
+    m_previewImageCacheSize = getConfigFromSettings("global",
+                                                    "preview_image_cache_size").toInt();
+
+    m_enablePreviewImageThumbnail = getConfigFromSettings("global",
+                                                          "enable_preview_image_thumbnail").toBool();
+
+    m_previewImageThumbnailCacheSize = getConfigFromSettings("global",
+                                                             "preview_image_thumbnail_cache_size").toInt();
+
+    m_previewImageDownloadCacheSize = getConfigFromSettings("global",
+                                                            "preview_image_download_cache_size").toInt();
+
+    m_maxConcurrentPreviewImageDownloads = getConfigFromSettings("global",
+                                                                 "max_concurrent_preview_image_downloads").toInt();
+
+    m_previewImageDecodeScreens = getConfigFromSettings("global",
+                                                        "preview_image_decode_screens").toInt();
+
+    m_previewImageTilePixels = getConfigFromSettings("global",
+                                                     "preview_image_tile_pixels").toInt();
+
     m_enablePreviewImageConstraint = getConfigFromSettings("global",
                                                            "enable_preview_image_constraint").toBool();
 
@@ -230,6 +261,15 @@ void VConfigManager::initialize()
     m_recycleBinFolderExt = getConfigFromSettings("global",
                                                   "external_recycle_bin_folder").toString();
 
+    m_enableNotebookIndex = getConfigFromSettings("global",
+                                                  "enable_notebook_index").toBool();
+
+    m_enableDirectoryPrefetch = getConfigFromSettings("global",
+                                                      "enable_directory_prefetch").toBool();
+
+    m_enableNotebookWatcher = getConfigFromSettings("global",
+                                                    "enable_notebook_watcher").toBool();
+
     m_confirmImagesCleanUp = getConfigFromSettings("global",
                                                    "confirm_images_clean_up").toBool();
 
@@ -494,6 +534,11 @@ QJsonObject VConfigManager::readDirectoryConfig(const QString &path)
     return QJsonDocument::fromJson(configData).object();
 }
 
+QString VConfigManager::getDirConfigFilePath(const QString &p_path)
+{
+    return QDir(p_path).filePath(c_dirConfigFile);
+}
+
 bool VConfigManager::directoryConfigExist(const QString &path)
 {
      return QFileInfo::exists(fetchDirConfigFilePath(path));
@@ -503,7 +548,9 @@ bool VConfigManager::writeDirectoryConfig(const QString &path, const QJsonObject
 {
     QString configFile = fetchDirConfigFilePath(path);
 
-    QFile config(configFile);
+    // Write to a temporary file and replace the config file with it, so a
+    // crash will not leave a truncated config file.
+    QSaveFile config(configFile);
     // We use Unix LF for config file.
     if (!config.open(QIODevice::WriteOnly)) {
         qWarning() << "fail to open directory configuration file for write:"
@@ -513,6 +560,12 @@ bool VConfigManager::writeDirectoryConfig(const QString &path, const QJsonObject
 
     QJsonDocument configDoc(configJson);
     config.write(configDoc.toJson());
+    if (!config.commit()) {
+        qWarning() << "fail to write directory configuration file:"
+                   << configFile;
+        return false;
+    }
+
     return true;
 }
 
@@ -536,6 +589,26 @@ QString VConfigManager::getLogFilePath() const
     return QDir(getConfigFolder()).filePath("vnote.log");
 }
 
+QString VConfigManager::getCodeBlockHighlightCacheFilePath() const
+{
+    return QDir(getConfigFolder()).filePath("code_block_highlight.cache");
+}
+
+QString VConfigManager::getPreviewImageThumbnailFolder() const
+{
+    return QDir(getConfigFolder()).filePath("preview_thumbnails");
+}
+
+QString VConfigManager::getPreviewImageDownloadCacheFolder() const
+{
+    return QDir(getConfigFolder()).filePath("preview_downloads");
+}
+
+QString VConfigManager::getNotebookIndexFolder() const
+{
+    return QDir(getConfigFolder()).filePath("notebook_index");
+}
+
 void VConfigManager::updateMarkdownEditStyle()
 {
     static const QString defaultCurrentLineBackground = "#C5CAE9";
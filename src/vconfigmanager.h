@@ -69,6 +69,10 @@ public:
 
     static bool writeDirectoryConfig(const QString &path, const QJsonObject &configJson);
     static bool directoryConfigExist(const QString &path);
+
+    // Get the path of the config file of directory @p_path without checking
+    // the obsolete one.
+    static QString getDirConfigFilePath(const QString &p_path);
     static bool deleteDirectoryConfig(const QString &path);
 
     // Get the path of the folder used to store default notebook.
@@ -97,6 +101,18 @@ public:
 
     QString getLogFilePath() const;
 
+    // Get the file path of the cache of code block highlight results.
+    QString getCodeBlockHighlightCacheFilePath() const;
+
+    // Get the folder of the thumbnails of previewed images.
+    QString getPreviewImageThumbnailFolder() const;
+
+    // Get the folder of the disk cache of downloaded previewed images.
+    QString getPreviewImageDownloadCacheFolder() const;
+
+    // Get the folder of the binary snapshots of notebooks.
+    QString getNotebookIndexFolder() const;
+
     // Get the css style URL for web view.
     QString getCssStyleUrl() const;
 
@@ -213,9 +229,29 @@ public:
     bool getEnableCodeBlockHighlight() const;
     void setEnableCodeBlockHighlight(bool p_enabled);
 
+    bool getEnableNativeCodeBlockHighlight() const;
+
+    int getCodeBlockHighlightCacheSize() const;
+
+    int getLazyLayoutBlockThreshold() const;
+
     bool getEnablePreviewImages() const;
     void setEnablePreviewImages(bool p_enabled);
 
+    int getPreviewImageCacheSize() const;
+
+    bool getEnablePreviewImageThumbnail() const;
+
+    int getPreviewImageThumbnailCacheSize() const;
+
+    int getPreviewImageDownloadCacheSize() const;
+
+    int getMaxConcurrentPreviewImageDownloads() const;
+
+    int getPreviewImageDecodeScreens() const;
+
+    int getPreviewImageTilePixels() const;
+
     bool getEnablePreviewImageConstraint() const;
     void setEnablePreviewImageConstraint(bool p_enabled);
 
@@ -297,6 +333,12 @@ public:
 
     const QString &getRecycleBinFolderExt() const;
 
+    bool getEnableNotebookIndex() const;
+
+    bool getEnableDirectoryPrefetch() const;
+
+    bool getEnableNotebookWatcher() const;
+
     bool getConfirmImagesCleanUp() const;
     void setConfirmImagesCleanUp(bool p_enabled);
 
@@ -589,9 +631,42 @@ private:
     // Enable colde block syntax highlight.
     bool m_enableCodeBlockHighlight;
 
+    // Highlight code blocks of common languages natively instead of in the web side.
+    bool m_enableNativeCodeBlockHighlight;
+
+    // Memory budget in KB of the cache of code block highlight results.
+    int m_codeBlockHighlightCacheSize;
+
+    // Lay out blocks on demand when more blocks than this need to be laid out
+    // at once. 0 to disable.
+    int m_lazyLayoutBlockThreshold;
+
     // Preview images in edit mode.
     bool m_enablePreviewImages;
 
+    // Memory budget in KB of previewed images of all the editors.
+    int m_previewImageCacheSize;
+
+    // Cache downscaled previewed images as thumbnails.
+    bool m_enablePreviewImageThumbnail;
+
+    // Max size in KB of the thumbnails of previewed images.
+    int m_previewImageThumbnailCacheSize;
+
+    // Max size in KB of the disk cache of downloaded previewed images.
+    int m_previewImageDownloadCacheSize;
+
+    // Max number of previewed images being downloaded at the same time.
+    int m_maxConcurrentPreviewImageDownloads;
+
+    // Only decode previewed images within this number of screens around the
+    // viewport. 0 to decode all of them.
+    int m_previewImageDecodeScreens;
+
+    // Decode previewed images with more pixels than this in tiles.
+    // 0 to disable it.
+    int m_previewImageTilePixels;
+
     // Constrain the width of image preview in edit mode.
     bool m_enablePreviewImageConstraint;
 
@@ -700,6 +775,15 @@ private:
     // Default name of the recycle bin folder of external files.
     QString m_recycleBinFolderExt;
 
+    // Keep a binary snapshot of the directory configs of each notebook.
+    bool m_enableNotebookIndex;
+
+    // Read the configs of the directories likely to be opened next in background.
+    bool m_enableDirectoryPrefetch;
+
+    // Reload the directories changed outside.
+    bool m_enableNotebookWatcher;
+
     // Confirm before deleting unused images.
     bool m_confirmImagesCleanUp;
 
@@ -1308,6 +1392,21 @@ inline void VConfigManager::setEnableCodeBlockHighlight(bool p_enabled)
                         m_enableCodeBlockHighlight);
 }
 
+inline bool VConfigManager::getEnableNativeCodeBlockHighlight() const
+{
+    return m_enableNativeCodeBlockHighlight;
+}
+
+inline int VConfigManager::getCodeBlockHighlightCacheSize() const
+{
+    return m_codeBlockHighlightCacheSize;
+}
+
+inline int VConfigManager::getLazyLayoutBlockThreshold() const
+{
+    return m_lazyLayoutBlockThreshold;
+}
+
 inline bool VConfigManager::getEnablePreviewImages() const
 {
     return m_enablePreviewImages;
@@ -1324,6 +1423,41 @@ inline void VConfigManager::setEnablePreviewImages(bool p_enabled)
                         m_enablePreviewImages);
 }
 
+inline int VConfigManager::getPreviewImageCacheSize() const
+{
+    return m_previewImageCacheSize;
+}
+
+inline bool VConfigManager::getEnablePreviewImageThumbnail() const
+{
+    return m_enablePreviewImageThumbnail;
+}
+
+inline int VConfigManager::getPreviewImageThumbnailCacheSize() const
+{
+    return m_previewImageThumbnailCacheSize;
+}
+
+inline int VConfigManager::getPreviewImageDownloadCacheSize() const
+{
+    return m_previewImageDownloadCacheSize;
+}
+
+inline int VConfigManager::getMaxConcurrentPreviewImageDownloads() const
+{
+    return m_maxConcurrentPreviewImageDownloads;
+}
+
+inline int VConfigManager::getPreviewImageDecodeScreens() const
+{
+    return m_previewImageDecodeScreens;
+}
+
+inline int VConfigManager::getPreviewImageTilePixels() const
+{
+    return m_previewImageTilePixels;
+}
+
 inline bool VConfigManager::getEnablePreviewImageConstraint() const
 {
     return m_enablePreviewImageConstraint;
@@ -1713,6 +1847,21 @@ inline const QString &VConfigManager::getRecycleBinFolderExt() const
     return m_recycleBinFolderExt;
 }
 
+inline bool VConfigManager::getEnableNotebookIndex() const
+{
+    return m_enableNotebookIndex;
+}
+
+inline bool VConfigManager::getEnableDirectoryPrefetch() const
+{
+    return m_enableDirectoryPrefetch;
+}
+
+inline bool VConfigManager::getEnableNotebookWatcher() const
+{
+    return m_enableNotebookWatcher;
+}
+
 inline bool VConfigManager::getConfirmImagesCleanUp() const
 {
     return m_confirmImagesCleanUp;
@@ -1,14 +1,18 @@
 #include "vdirectory.h"
 #include <QDir>
+#include <QHash>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QDebug>
 #include "vconfigmanager.h"
 #include "vnotefile.h"
+#include "vnotebookindex.h"
 #include "utils/vutils.h"
 
 extern VConfigManager *g_config;
 
+int VDirectory::s_cachedPathGeneration = 0;
+
 VDirectory::VDirectory(VNotebook *p_notebook,
                        VDirectory *p_parent,
                        const QString &p_name,
@@ -18,7 +22,8 @@ VDirectory::VDirectory(VNotebook *p_notebook,
       m_name(p_name),
       m_opened(false),
       m_expanded(false),
-      m_createdTimeUtc(p_createdTimeUtc)
+      m_createdTimeUtc(p_createdTimeUtc),
+      m_cachedPathGeneration(-1)
 {
 }
 
@@ -31,7 +36,7 @@ bool VDirectory::open()
     V_ASSERT(m_subDirs.isEmpty() && m_files.isEmpty());
 
     QString path = fetchPath();
-    QJsonObject configJson = VConfigManager::readDirectoryConfig(path);
+    QJsonObject configJson = m_notebook->readDirectoryConfig(path);
     if (configJson.isEmpty()) {
         qWarning() << "invalid directory configuration in path" << path;
         return false;
@@ -61,15 +66,140 @@ bool VDirectory::open()
     }
 
     m_opened = true;
+
+    m_notebook->watchDirectory(this);
     return true;
 }
 
+bool VDirectory::reloadConfig(QVector<VDirectory *> &p_removedDirs,
+                              QVector<VNoteFile *> &p_removedFiles)
+{
+    if (!m_opened) {
+        return false;
+    }
+
+    QString path = fetchPath();
+    QJsonObject configJson = m_notebook->readDirectoryConfig(path);
+    if (configJson.isEmpty()) {
+        qWarning() << "invalid directory configuration in path" << path;
+        return false;
+    }
+
+    bool changed = false;
+
+    // created_time
+    QDateTime createdTime = QDateTime::fromString(configJson[DirConfig::c_createdTime].toString(),
+                                                  Qt::ISODate);
+    if (createdTime != m_createdTimeUtc) {
+        m_createdTimeUtc = createdTime;
+        changed = true;
+    }
+
+    // [sub_directories] section
+    QHash<QString, VDirectory *> oldDirs;
+    for (auto dir : m_subDirs) {
+        oldDirs.insert(dir->getName(), dir);
+    }
+
+    QVector<VDirectory *> subDirs;
+    QJsonArray dirJson = configJson[DirConfig::c_subDirectories].toArray();
+    for (int i = 0; i < dirJson.size(); ++i) {
+        QString name = dirJson[i].toObject()[DirConfig::c_name].toString();
+        VDirectory *dir = oldDirs.take(name);
+        if (!dir) {
+            dir = new VDirectory(m_notebook, this, name);
+        }
+
+        subDirs.append(dir);
+    }
+
+    for (auto dir : oldDirs) {
+        if (dir->hasOpenedFiles()) {
+            qWarning() << "keep removed folder with opened notes" << dir->getName();
+            subDirs.append(dir);
+        } else {
+            p_removedDirs.append(dir);
+        }
+    }
+
+    if (subDirs != m_subDirs) {
+        m_subDirs = subDirs;
+        changed = true;
+    }
+
+    // [files] section
+    QHash<QString, VNoteFile *> oldFiles;
+    for (auto file : m_files) {
+        oldFiles.insert(file->getName(), file);
+    }
+
+    QVector<VNoteFile *> files;
+    QJsonArray fileJson = configJson[DirConfig::c_files].toArray();
+    for (int i = 0; i < fileJson.size(); ++i) {
+        QJsonObject fileItem = fileJson[i].toObject();
+        VNoteFile *file = oldFiles.take(fileItem[DirConfig::c_name].toString());
+        if (file) {
+            if (file->updateConfig(fileItem)) {
+                changed = true;
+            }
+        } else {
+            file = VNoteFile::fromJson(this,
+                                       fileItem,
+                                       FileType::Note,
+                                       true);
+        }
+
+        files.append(file);
+    }
+
+    for (auto file : oldFiles) {
+        if (file->isOpened()) {
+            qWarning() << "keep removed opened note" << file->getName();
+            files.append(file);
+        } else {
+            p_removedFiles.append(file);
+        }
+    }
+
+    if (files != m_files) {
+        m_files = files;
+        changed = true;
+    }
+
+    if (changed) {
+        qDebug() << "folder reloaded" << path
+                 << "removed" << p_removedDirs.size() << "folders"
+                 << p_removedFiles.size() << "notes";
+    }
+
+    return changed;
+}
+
+bool VDirectory::hasOpenedFiles() const
+{
+    for (auto file : m_files) {
+        if (file->isOpened()) {
+            return true;
+        }
+    }
+
+    for (auto dir : m_subDirs) {
+        if (dir->hasOpenedFiles()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 void VDirectory::close()
 {
     if (!m_opened) {
         return;
     }
 
+    m_notebook->unwatchDirectory(this);
+
     for (int i = 0; i < m_subDirs.size(); ++i) {
         VDirectory *dir = m_subDirs[i];
         dir->close();
@@ -92,32 +222,23 @@ QString VDirectory::fetchBasePath() const
     return VUtils::basePathFromPath(fetchPath());
 }
 
-QString VDirectory::fetchPath(const VDirectory *p_dir) const
+void VDirectory::updateCachedPaths() const
 {
-    if (!p_dir) {
-        return "";
-    }
-    VDirectory *parentDir = (VDirectory *)p_dir->parent();
-    if (parentDir) {
-        // Not the root directory
-        return QDir(fetchPath(parentDir)).filePath(p_dir->getName());
-    } else {
-        return m_notebook->getPath();
+    if (m_cachedPathGeneration == s_cachedPathGeneration) {
+        return;
     }
-}
 
-QString VDirectory::fetchRelativePath(const VDirectory *p_dir) const
-{
-    if (!p_dir) {
-        return "";
-    }
-    VDirectory *parentDir = (VDirectory *)p_dir->parent();
+    const VDirectory *parentDir = getParentDirectory();
     if (parentDir) {
-        // Not the root directory
-        return QDir(fetchRelativePath(parentDir)).filePath(p_dir->getName());
+        // Not the root directory. Parent's paths are cached too.
+        m_cachedPath = QDir(parentDir->fetchPath()).filePath(m_name);
+        m_cachedRelativePath = QDir(parentDir->fetchRelativePath()).filePath(m_name);
     } else {
-        return "";
+        m_cachedPath = m_notebook->getPath();
+        m_cachedRelativePath = "";
     }
+
+    m_cachedPathGeneration = s_cachedPathGeneration;
 }
 
 QJsonObject VDirectory::toConfigJson() const
@@ -172,7 +293,7 @@ bool VDirectory::updateFileConfig(const VNoteFile *p_file)
 
 bool VDirectory::writeToConfig(const QJsonObject &p_json) const
 {
-    return VConfigManager::writeDirectoryConfig(fetchPath(), p_json);
+    return m_notebook->writeDirectoryConfig(fetchPath(), p_json);
 }
 
 void VDirectory::addNotebookConfig(QJsonObject &p_json) const
@@ -348,6 +469,7 @@ bool VDirectory::addFile(VNoteFile *p_file, int p_index)
     }
 
     p_file->setParent(this);
+    invalidateCachedPaths();
 
     qDebug() << "note" << p_file->getName() << "added to folder" << m_name;
 
@@ -402,6 +524,7 @@ bool VDirectory::addSubDirectory(VDirectory *p_dir, int p_index)
     }
 
     p_dir->setParent(this);
+    invalidateCachedPaths();
 
     qDebug() << "folder" << p_dir->getName() << "added to folder" << m_name;
 
@@ -438,6 +561,10 @@ bool VDirectory::deleteDirectory(bool p_skipRecycleBin, QString *p_errMsg)
     // Delete the entire directory.
     bool ret = true;
     QString dirPath = fetchPath();
+
+    // Configs within it will be moved to the recycle bin.
+    VNotebookIndex::flushDirectory(dirPath);
+
     if (!VUtils::deleteDirectory(m_notebook, dirPath, p_skipRecycleBin)) {
         VUtils::addErrMsg(p_errMsg, tr("Fail to delete the directory %1.").arg(dirPath));
         ret = false;
@@ -513,6 +640,9 @@ bool VDirectory::rename(const QString &p_name)
 
     VDirectory *parentDir = getParentDirectory();
     V_ASSERT(parentDir);
+    // Pending configs are written to the old paths.
+    VNotebookIndex::flushDirectory(fetchPath());
+
     // Rename it in disk.
     QDir dir(parentDir->fetchPath());
     if (!dir.rename(m_name, p_name)) {
@@ -520,11 +650,11 @@ bool VDirectory::rename(const QString &p_name)
         return false;
     }
 
-    m_name = p_name;
+    setName(p_name);
 
     // Update parent's config file
     if (!parentDir->writeToConfig()) {
-        m_name = oldName;
+        setName(oldName);
         dir.rename(p_name, m_name);
         return false;
     }
@@ -562,6 +692,9 @@ bool VDirectory::copyDirectory(VDirectory *p_destDir,
     Q_ASSERT(paDir->isOpened());
 
     // Copy the directory.
+    // Configs within it should be up to date in disk before copying.
+    VNotebookIndex::flushDirectory(srcPath);
+
     if (!VUtils::copyDirectory(srcPath, destPath, p_isCut)) {
         VUtils::addErrMsg(p_errMsg, tr("Fail to %1 the folder.").arg(opStr));
         qWarning() << "fail to" << opStr << "the folder directory" << srcPath << "to" << destPath;
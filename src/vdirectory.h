@@ -24,6 +24,18 @@ public:
     bool open();
     void close();
 
+    // Re-read the config of this opened directory and apply the changes of
+    // the sub-directories and files, keeping the unchanged ones untouched.
+    // Removed sub-directories and files are taken out into @p_removedDirs and
+    // @p_removedFiles, and the caller should close and delete them. Those
+    // containing opened notes are kept.
+    // Return true if anything is changed.
+    bool reloadConfig(QVector<VDirectory *> &p_removedDirs,
+                      QVector<VNoteFile *> &p_removedFiles);
+
+    // Whether any note within this directory is opened.
+    bool hasOpenedFiles() const;
+
     // Create a sub-directory with name @p_name.
     VDirectory *createSubDirectory(const QString &p_name,
                                    QString *p_errMsg = NULL);
@@ -119,11 +131,16 @@ public:
                                 bool p_skipRecycleBin = false,
                                 QString *p_errMsg = NULL);
 
+    // Make the cached paths of all the directories and files obsolete.
+    // Should be called once any of them is renamed or moved.
+    static void invalidateCachedPaths();
+
+    // Increased each time the cached paths are invalidated.
+    static int cachedPathGeneration();
+
 private:
-    // Get the path of @p_dir recursively
-    QString fetchPath(const VDirectory *p_dir) const;
-    // Get teh relative path of @p_dir recursively related to the notebook path
-    QString fetchRelativePath(const VDirectory *p_dir) const;
+    // Re-compute the cached paths from the parent if they are obsolete.
+    void updateCachedPaths() const;
 
     // Write @p_json to config.
     bool writeToConfig(const QJsonObject &p_json) const;
@@ -163,6 +180,16 @@ private:
     // UTC time when creating this directory.
     // Loaded after open().
     QDateTime m_createdTimeUtc;
+
+    // Cached absolute path and path relative to the notebook.
+    mutable QString m_cachedPath;
+    mutable QString m_cachedRelativePath;
+
+    // Generation of the cached paths. They are obsolete if it differs from
+    // s_cachedPathGeneration.
+    mutable int m_cachedPathGeneration;
+
+    static int s_cachedPathGeneration;
 };
 
 inline const QVector<VDirectory *> &VDirectory::getSubDirs() const
@@ -178,6 +205,7 @@ inline const QString &VDirectory::getName() const
 inline void VDirectory::setName(const QString &p_name)
 {
     m_name = p_name;
+    invalidateCachedPaths();
 }
 
 inline bool VDirectory::isOpened() const
@@ -217,12 +245,24 @@ inline const VNotebook *VDirectory::getNotebook() const
 
 inline QString VDirectory::fetchPath() const
 {
-    return fetchPath(this);
+    updateCachedPaths();
+    return m_cachedPath;
 }
 
 inline QString VDirectory::fetchRelativePath() const
 {
-    return fetchRelativePath(this);
+    updateCachedPaths();
+    return m_cachedRelativePath;
+}
+
+inline void VDirectory::invalidateCachedPaths()
+{
+    ++s_cachedPathGeneration;
+}
+
+inline int VDirectory::cachedPathGeneration()
+{
+    return s_cachedPathGeneration;
 }
 
 inline bool VDirectory::isExpanded() const
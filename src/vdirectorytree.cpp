@@ -12,6 +12,7 @@
 #include "dialog/vsortdialog.h"
 #include "utils/vimnavigationforwidget.h"
 #include "utils/viconutils.h"
+#include "vnotebookindex.h"
 
 extern VMainWindow *g_mainWin;
 
@@ -145,11 +146,19 @@ void VDirectoryTree::setNotebook(VNotebook *p_notebook)
     }
 
     clear();
+    if (m_notebook) {
+        disconnect(m_notebook.data(), &VNotebook::directoryReloaded,
+                   this, &VDirectoryTree::handleDirectoryReloaded);
+    }
+
     m_notebook = p_notebook;
     if (!m_notebook) {
         return;
     }
 
+    connect(m_notebook.data(), &VNotebook::directoryReloaded,
+            this, &VDirectoryTree::handleDirectoryReloaded);
+
     if (!m_notebook->open()) {
         VUtils::showMessage(QMessageBox::Warning,
                             tr("Warning"),
@@ -193,6 +202,8 @@ void VDirectoryTree::updateDirectoryTree()
         buildSubTree(item, 1);
     }
 
+    prefetchChildren(NULL);
+
     if (!restoreCurrentItem() && topLevelItemCount() > 0) {
         setCurrentItem(topLevelItem(0));
     }
@@ -272,6 +283,8 @@ void VDirectoryTree::handleItemExpanded(QTreeWidgetItem *p_item)
 
         VDirectory *dir = getVDirectory(p_item);
         dir->setExpanded(true);
+
+        prefetchChildren(p_item);
     }
 }
 
@@ -293,6 +306,40 @@ void VDirectoryTree::buildChildren(QTreeWidgetItem *p_item)
     }
 }
 
+void VDirectoryTree::handleDirectoryReloaded(VDirectory *p_directory)
+{
+    bool isWidget;
+    QTreeWidgetItem *item = findVDirectory(p_directory, &isWidget);
+    if (item || isWidget) {
+        updateItemDirectChildren(item);
+    }
+
+    emit directoryReloaded(p_directory);
+}
+
+void VDirectoryTree::prefetchChildren(QTreeWidgetItem *p_item)
+{
+    QStringList paths;
+    int nrChild = p_item ? p_item->childCount() : topLevelItemCount();
+    for (int i = 0; i < nrChild; ++i) {
+        QTreeWidgetItem *item = p_item ? p_item->child(i) : topLevelItem(i);
+        const VDirectory *dir = getVDirectory(item);
+        if (!dir || !dir->isOpened()) {
+            continue;
+        }
+
+        for (auto const &subDir : dir->getSubDirs()) {
+            if (!subDir->isOpened()) {
+                paths.append(subDir->fetchPath());
+            }
+        }
+    }
+
+    if (!paths.isEmpty()) {
+        m_notebook->prefetchDirectoryConfigs(paths);
+    }
+}
+
 void VDirectoryTree::updateItemDirectChildren(QTreeWidgetItem *p_item)
 {
     QPointer<VDirectory> parentDir;
@@ -781,6 +828,9 @@ void VDirectoryTree::pasteDirectories(VDirectory *p_destDir,
         return;
     }
 
+    // Write the configs of the folders once.
+    VNotebookIndex::beginBatch();
+
     int nrPasted = 0;
     for (int i = 0; i < p_dirs.size(); ++i) {
         VDirectory *dir = g_vnote->getInternalDirectory(p_dirs[i]);
@@ -860,6 +910,16 @@ void VDirectoryTree::pasteDirectories(VDirectory *p_destDir,
         }
     }
 
+    if (!VNotebookIndex::endBatch()) {
+        VUtils::showMessage(QMessageBox::Warning,
+                            tr("Warning"),
+                            tr("Fail to write the configuration files of the folders."),
+                            tr("Please check the permissions of these folders."),
+                            QMessageBox::Ok,
+                            QMessageBox::Ok,
+                            this);
+    }
+
     qDebug() << "pasted" << nrPasted << "directories";
     if (nrPasted > 0) {
         g_mainWin->showStatusMessage(tr("%1 %2 pasted")
@@ -37,6 +37,10 @@ signals:
 
     void directoryUpdated(const VDirectory *p_directory);
 
+    // Emitted after the contents of @p_directory are reloaded since they are
+    // changed outside.
+    void directoryReloaded(const VDirectory *p_directory);
+
 public slots:
     // Set directory tree to display a given notebook @p_notebook.
     void setNotebook(VNotebook *p_notebook);
@@ -89,6 +93,10 @@ private slots:
     // Sort sub-folders of current item's folder.
     void sortItems();
 
+    // Update the items of @p_directory of current notebook reloaded since it
+    // is changed outside.
+    void handleDirectoryReloaded(VDirectory *p_directory);
+
 protected:
     void mousePressEvent(QMouseEvent *event) Q_DECL_OVERRIDE;
 
@@ -126,6 +134,11 @@ private:
     // We need to fill the children before showing a item to get a correct render.
     void buildChildren(QTreeWidgetItem *p_item);
 
+    // Prefetch the configs of the unopened sub-directories of @p_item's
+    // children, which are likely to be opened next.
+    // @p_item: NULL for the top-level items.
+    void prefetchChildren(QTreeWidgetItem *p_item);
+
     // Expand/create the directory tree nodes to @p_directory.
     QTreeWidgetItem *expandToVDirectory(const VDirectory *p_directory);
 
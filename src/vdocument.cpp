@@ -67,14 +67,19 @@ void VDocument::keyPressEvent(int p_key, bool p_ctrl, bool p_shift)
     emit keyPressed(p_key, p_ctrl, p_shift);
 }
 
-void VDocument::highlightTextAsync(const QString &p_text, int p_id, int p_timeStamp)
+void VDocument::highlightTextsAsync(const QStringList &p_texts,
+                                    const QJsonArray &p_ids,
+                                    int p_timeStamp)
 {
-    emit requestHighlightText(p_text, p_id, p_timeStamp);
+    emit requestHighlightTexts(p_texts, p_ids, p_timeStamp);
 }
 
-void VDocument::highlightTextCB(const QString &p_html, int p_id, int p_timeStamp)
+void VDocument::highlightTextCB(const QJsonArray &p_classes,
+                                const QJsonArray &p_triples,
+                                int p_id,
+                                int p_timeStamp)
 {
-    emit textHighlighted(p_html, p_id, p_timeStamp);
+    emit textHighlighted(p_classes, p_triples, p_id, p_timeStamp);
 }
 
 void VDocument::noticeReadyToHighlightText()
@@ -3,6 +3,8 @@
 
 #include <QObject>
 #include <QString>
+#include <QStringList>
+#include <QJsonArray>
 
 class VFile;
 
@@ -25,9 +27,10 @@ public:
 
     void setHtml(const QString &html);
 
-    // Request to highlight a segment text.
-    // Use p_id to identify the result.
-    void highlightTextAsync(const QString &p_text, int p_id, int p_timeStamp);
+    // Request to highlight a batch of code blocks in one message, in the order
+    // of @p_texts. Use @p_ids to identify the results.
+    // It cancels any batch in flight, so an empty batch just cancels.
+    void highlightTextsAsync(const QStringList &p_texts, const QJsonArray &p_ids, int p_timeStamp);
 
     void setFile(const VFile *p_file);
 
@@ -49,7 +52,14 @@ public slots:
     void setLog(const QString &p_log);
     void keyPressEvent(int p_key, bool p_ctrl, bool p_shift);
     void updateText();
-    void highlightTextCB(const QString &p_html, int p_id, int p_timeStamp);
+
+    // @p_classes: classes of the highlight units.
+    // @p_triples: flat array of (offset, length, class-id) triples.
+    void highlightTextCB(const QJsonArray &p_classes,
+                         const QJsonArray &p_triples,
+                         int p_id,
+                         int p_timeStamp);
+
     void noticeReadyToHighlightText();
 
     // Web-side handle logics (MathJax etc.) is finished.
@@ -68,8 +78,11 @@ signals:
     void htmlChanged(const QString &html);
     void logChanged(const QString &p_log);
     void keyPressed(int p_key, bool p_ctrl, bool p_shift);
-    void requestHighlightText(const QString &p_text, int p_id, int p_timeStamp);
-    void textHighlighted(const QString &p_html, int p_id, int p_timeStamp);
+    void requestHighlightTexts(const QStringList &p_texts, const QJsonArray &p_ids, int p_timeStamp);
+    void textHighlighted(const QJsonArray &p_classes,
+                         const QJsonArray &p_triples,
+                         int p_id,
+                         int p_timeStamp);
     void readyToHighlightText();
     void logicsFinished();
 
@@ -1,7 +1,11 @@
 #include "vdownloader.h"
 
+#include <QNetworkDiskCache>
+
 VDownloader::VDownloader(QObject *parent)
-    : QObject(parent)
+    : QObject(parent),
+      m_maxConcurrentRequests(0),
+      m_nrActiveRequests(0)
 {
     connect(&webCtrl, &QNetworkAccessManager::finished,
             this, &VDownloader::handleDownloadFinished);
@@ -9,10 +13,33 @@ VDownloader::VDownloader(QObject *parent)
 
 void VDownloader::handleDownloadFinished(QNetworkReply *reply)
 {
-    data = reply->readAll();
     reply->deleteLater();
-    qDebug() << "VDownloader receive" << reply->url().toString();
-    emit downloadFinished(data, reply->url().toString());
+    --m_nrActiveRequests;
+
+    QNetworkRequest request = reply->request();
+    QUrl url = request.url();
+    QNetworkReply::NetworkError err = reply->error();
+    if (err != QNetworkReply::NoError
+        && err <= QNetworkReply::UnknownNetworkError
+        && webCtrl.cache()
+        && webCtrl.cache()->metaData(url).isValid()) {
+        // Network is unreachable. Fall back to the cached one.
+        int control = request.attribute(QNetworkRequest::CacheLoadControlAttribute,
+                                        QNetworkRequest::PreferNetwork).toInt();
+        if (control != QNetworkRequest::AlwaysCache) {
+            qDebug() << "VDownloader fall back to cache" << url.toString() << err;
+            get(url, QNetworkRequest::AlwaysCache);
+            return;
+        }
+    }
+
+    data = reply->readAll();
+    m_requests.remove(url);
+    qDebug() << "VDownloader receive" << url.toString()
+             << "from cache" << reply->attribute(QNetworkRequest::SourceIsFromCacheAttribute).toBool();
+    emit downloadFinished(data, url.toString());
+
+    startQueuedRequests();
 }
 
 void VDownloader::download(const QUrl &p_url)
@@ -21,7 +48,48 @@ void VDownloader::download(const QUrl &p_url)
         return;
     }
 
+    if (m_requests.contains(p_url)) {
+        qDebug() << "VDownloader coalesce" << p_url.toString();
+        return;
+    }
+
+    m_requests.insert(p_url);
+    m_queue.enqueue(p_url);
+    startQueuedRequests();
+}
+
+void VDownloader::startQueuedRequests()
+{
+    while (!m_queue.isEmpty()
+           && (m_maxConcurrentRequests <= 0
+               || m_nrActiveRequests < m_maxConcurrentRequests)) {
+        get(m_queue.dequeue(), QNetworkRequest::PreferNetwork);
+    }
+}
+
+void VDownloader::get(const QUrl &p_url, QNetworkRequest::CacheLoadControl p_control)
+{
     QNetworkRequest request(p_url);
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, p_control);
     webCtrl.get(request);
+    ++m_nrActiveRequests;
     qDebug() << "VDownloader get" << p_url.toString();
 }
+
+void VDownloader::setDiskCache(const QString &p_folder, qint64 p_maxSize)
+{
+    QNetworkDiskCache *cache = new QNetworkDiskCache(this);
+    cache->setCacheDirectory(p_folder);
+    if (p_maxSize > 0) {
+        cache->setMaximumCacheSize(p_maxSize);
+    }
+
+    // The access manager takes the ownership.
+    webCtrl.setCache(cache);
+}
+
+void VDownloader::setMaxConcurrentRequests(int p_max)
+{
+    m_maxConcurrentRequests = p_max;
+    startQueuedRequests();
+}
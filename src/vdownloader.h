@@ -4,6 +4,8 @@
 #include <QObject>
 #include <QUrl>
 #include <QByteArray>
+#include <QSet>
+#include <QQueue>
 #include <QNetworkAccessManager>
 #include <QNetworkRequest>
 #include <QNetworkReply>
@@ -13,8 +15,18 @@ class VDownloader : public QObject
     Q_OBJECT
 public:
     explicit VDownloader(QObject *parent = 0);
+
+    // Requests of the same URL in flight or queued are coalesced into one.
     void download(const QUrl &p_url);
 
+    // Cache the downloaded data in folder @p_folder. Stale entries are
+    // revalidated with ETag/Last-Modified and used when offline.
+    // @p_maxSize: max size in bytes of the cache, 0 for the default one.
+    void setDiskCache(const QString &p_folder, qint64 p_maxSize = 0);
+
+    // Max number of requests in flight at the same time, 0 for no limit.
+    void setMaxConcurrentRequests(int p_max);
+
 signals:
     void downloadFinished(const QByteArray &data, const QString &url);
 
@@ -22,8 +34,22 @@ private slots:
     void handleDownloadFinished(QNetworkReply *reply);
 
 private:
+    void get(const QUrl &p_url, QNetworkRequest::CacheLoadControl p_control);
+
+    // Start queued requests as long as the limit permits.
+    void startQueuedRequests();
+
     QNetworkAccessManager webCtrl;
     QByteArray data;
+
+    // URLs in flight or queued.
+    QSet<QUrl> m_requests;
+
+    QQueue<QUrl> m_queue;
+
+    int m_maxConcurrentRequests;
+
+    int m_nrActiveRequests;
 };
 
 #endif // VDOWNLOADER_H
@@ -17,6 +17,7 @@
 #include "vmainwindow.h"
 #include "utils/vimnavigationforwidget.h"
 #include "utils/viconutils.h"
+#include "vnotebookindex.h"
 
 extern VConfigManager *g_config;
 extern VNote *g_vnote;
@@ -202,6 +203,55 @@ void VFileList::updateFileList()
     }
 }
 
+void VFileList::handleDirectoryReloaded(const VDirectory *p_directory)
+{
+    if (!m_directory || m_directory != p_directory) {
+        return;
+    }
+
+    QListWidgetItem *curItem = fileList->currentItem();
+    const VNoteFile *curFile = curItem ? getVFile(curItem).data() : NULL;
+
+    // Removed files are still alive at this point.
+    QHash<const VNoteFile *, QListWidgetItem *> itemFileMap;
+    int nrItem = fileList->count();
+    for (int i = 0; i < nrItem; ++i) {
+        QListWidgetItem *item = fileList->item(i);
+        itemFileMap.insert(getVFile(item), item);
+    }
+
+    const QVector<VNoteFile *> &files = m_directory->getFiles();
+    for (int i = 0; i < files.size(); ++i) {
+        VNoteFile *file = files[i];
+        QListWidgetItem *item = itemFileMap.take(file);
+        if (item) {
+            int row = fileList->row(item);
+            if (row != i) {
+                fileList->takeItem(row);
+                fileList->insertItem(i, item);
+            }
+        } else {
+            item = new QListWidgetItem();
+            fileList->insertItem(i, item);
+        }
+
+        fillItem(item, file);
+    }
+
+    // Delete items without corresponding VNoteFile.
+    for (auto item : itemFileMap) {
+        delete item;
+    }
+
+    QListWidgetItem *item = findItem(curFile);
+    if (item) {
+        fileList->setCurrentItem(item);
+    }
+
+    // Qt seems not to update the QListWidget correctly. Manually force it to repaint.
+    fileList->update();
+}
+
 void VFileList::fileInfo()
 {
     QList<QListWidgetItem *> items = fileList->selectedItems();
@@ -475,6 +525,9 @@ void VFileList::deleteFiles(const QVector<VNoteFile *> &p_files)
             files.push_back((VNoteFile *)item.m_data);
         }
 
+        // Write the config of the folder once.
+        VNotebookIndex::beginBatch();
+
         int nrDeleted = 0;
         for (auto file : files) {
             editArea->closeFile(file, true);
@@ -503,6 +556,16 @@ void VFileList::deleteFiles(const QVector<VNoteFile *> &p_files)
             }
         }
 
+        if (!VNotebookIndex::endBatch()) {
+            VUtils::showMessage(QMessageBox::Warning,
+                                tr("Warning"),
+                                tr("Fail to write the configuration files of the folders."),
+                                tr("Please check the permissions of these folders."),
+                                QMessageBox::Ok,
+                                QMessageBox::Ok,
+                                this);
+        }
+
         if (nrDeleted > 0) {
             g_mainWin->showStatusMessage(tr("%1 %2 deleted")
                                            .arg(nrDeleted)
@@ -720,6 +783,9 @@ void VFileList::pasteFiles(VDirectory *p_destDir,
         return;
     }
 
+    // Write the configs of the folders once.
+    VNotebookIndex::beginBatch();
+
     int nrPasted = 0;
     for (int i = 0; i < p_files.size(); ++i) {
         VNoteFile *file = g_vnote->getInternalFile(p_files[i]);
@@ -804,6 +870,16 @@ void VFileList::pasteFiles(VDirectory *p_destDir,
         }
     }
 
+    if (!VNotebookIndex::endBatch()) {
+        VUtils::showMessage(QMessageBox::Warning,
+                            tr("Warning"),
+                            tr("Fail to write the configuration files of the folders."),
+                            tr("Please check the permissions of these folders."),
+                            QMessageBox::Ok,
+                            QMessageBox::Ok,
+                            this);
+    }
+
     qDebug() << "pasted" << nrPasted << "files";
     if (nrPasted > 0) {
         g_mainWin->showStatusMessage(tr("%1 %2 pasted")
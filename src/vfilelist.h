@@ -60,6 +60,10 @@ public slots:
     // Create a note.
     void newFile();
 
+    // Update the items if @p_directory is the current directory, which is
+    // reloaded since it is changed outside.
+    void handleDirectoryReloaded(const VDirectory *p_directory);
+
 signals:
     void fileClicked(VNoteFile *p_file,
                      OpenFileMode p_mode = OpenFileMode::Read,
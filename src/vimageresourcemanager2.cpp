@@ -1,14 +1,181 @@
 #include "vimageresourcemanager2.h"
 
+#include <QDebug>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QPainter>
+
+QHash<QString, VImageResourceManager2::SharedImage> VImageResourceManager2::s_images;
+
+// No limit by default.
+qint64 VImageResourceManager2::s_budget = 0;
+
+qint64 VImageResourceManager2::s_usedBytes = 0;
+
+qint64 VImageResourceManager2::s_tick = 0;
+
+qint64 VImageResourceManager2::s_paintGeneration = 0;
+
+bool VImageResourceManager2::s_paintPending = false;
+
+qint64 VImageResourceManager2::s_hits = 0;
+
+qint64 VImageResourceManager2::s_misses = 0;
+
+qint64 VImageResourceManager2::s_evictions = 0;
 
 VImageResourceManager2::VImageResourceManager2()
 {
 }
 
+VImageResourceManager2::~VImageResourceManager2()
+{
+    clear();
+}
+
+QString VImageResourceManager2::storeKey(const QString &p_name,
+                                         const QString &p_path,
+                                         const QSize &p_size) const
+{
+    if (p_path.isEmpty()) {
+        // Private to this manager.
+        return QString("%1|%2").arg((quintptr)this, 0, 16).arg(p_name);
+    }
+
+    QFileInfo fi(p_path);
+    QString path = fi.canonicalFilePath();
+    if (path.isEmpty()) {
+        // URL of a downloaded image.
+        return QString("%1|%2x%3").arg(p_path).arg(p_size.width()).arg(p_size.height());
+    }
+
+    // Like the thumbnails, the file is treated as a new image once it is
+    // modified, so stale pixmaps are never shared after it is edited.
+    return QString("%1|%2|%3|%4x%5").arg(path)
+                                     .arg(fi.lastModified().toMSecsSinceEpoch())
+                                     .arg(fi.size())
+                                     .arg(p_size.width())
+                                     .arg(p_size.height());
+}
+
+void VImageResourceManager2::bindImage(const QString &p_name, const QString &p_key)
+{
+    auto it = m_images.find(p_name);
+    if (it == m_images.end()) {
+        m_images.insert(p_name, p_key);
+        ++s_images[p_key].m_refs;
+    } else if (it.value() != p_key) {
+        QString oldKey = it.value();
+        it.value() = p_key;
+        ++s_images[p_key].m_refs;
+        unrefImage(oldKey);
+    }
+}
+
+void VImageResourceManager2::unrefImage(const QString &p_key)
+{
+    auto it = s_images.find(p_key);
+    if (it == s_images.end()) {
+        return;
+    }
+
+    if (--it.value().m_refs <= 0) {
+        s_usedBytes -= it.value().m_cost;
+        s_images.erase(it);
+    }
+}
+
+const VImageResourceManager2::SharedImage *VImageResourceManager2::sharedImage(const QString &p_name) const
+{
+    auto it = m_images.find(p_name);
+    if (it == m_images.end()) {
+        return NULL;
+    }
+
+    auto sit = s_images.constFind(it.value());
+    if (sit == s_images.constEnd()) {
+        return NULL;
+    }
+
+    return &sit.value();
+}
+
 void VImageResourceManager2::addImage(const QString &p_name,
-                                      const QPixmap &p_image)
+                                      const QPixmap &p_image,
+                                      const QString &p_path)
+{
+    QString key = storeKey(p_name, p_path, p_image.size());
+    bindImage(p_name, key);
+
+    // Other managers sharing it will get the new one too.
+    SharedImage &img = s_images[key];
+    qint64 oldCost = img.m_cost;
+    s_usedBytes -= img.m_cost;
+
+    img.m_image = p_image;
+    img.m_size = p_image.size();
+    img.m_path = p_path;
+    img.m_cost = estimateCost(p_image);
+    img.m_lastUse = ++s_tick;
+    img.m_reloading = false;
+
+    s_usedBytes += img.m_cost;
+
+    // Frames of animated images are added again and again with the same cost,
+    // so only scan the store when more memory is used.
+    if (img.m_cost > oldCost) {
+        evictToFitBudget();
+    }
+}
+
+bool VImageResourceManager2::addSharedImage(const QString &p_name,
+                                            const QString &p_path,
+                                            const QSize &p_size)
+{
+    if (p_path.isEmpty()) {
+        return false;
+    }
+
+    QString key = storeKey(p_name, p_path, p_size);
+    auto it = s_images.find(key);
+    if (it == s_images.end() || it.value().isEvicted()) {
+        return false;
+    }
+
+    it.value().m_lastUse = ++s_tick;
+    bindImage(p_name, key);
+
+    qDebug() << "share preview image" << key << "refs" << s_images[key].m_refs;
+    return true;
+}
+
+bool VImageResourceManager2::paintImage(const QString &p_name,
+                                        const QPoint &p_pos,
+                                        const QImage &p_tile)
 {
-    m_images.insert(p_name, p_image);
+    // Paint on the only copy held by the store without detaching it.
+    SharedImage *img = const_cast<SharedImage *>(sharedImage(p_name));
+    if (!img || img->isEvicted()) {
+        return false;
+    }
+
+    QPainter painter(&img->m_image);
+    painter.setCompositionMode(QPainter::CompositionMode_Source);
+    painter.drawImage(p_pos, p_tile);
+    return true;
+}
+
+bool VImageResourceManager2::shareImage(const QString &p_name, const QString &p_path)
+{
+    const QPixmap *image = findImage(p_name);
+    if (!image) {
+        return false;
+    }
+
+    // The old entry is dropped once it is rebound, so hold the pixmap first.
+    QPixmap pixmap(*image);
+    addImage(p_name, pixmap, p_path);
+    return true;
 }
 
 bool VImageResourceManager2::contains(const QString &p_name) const
@@ -18,20 +185,150 @@ bool VImageResourceManager2::contains(const QString &p_name) const
 
 const QPixmap *VImageResourceManager2::findImage(const QString &p_name) const
 {
-    auto it = m_images.find(p_name);
-    if (it != m_images.end()) {
-        return &it.value();
+    const SharedImage *img = sharedImage(p_name);
+    if (img && !img->isEvicted()) {
+        return &img->m_image;
     }
 
     return NULL;
 }
 
+const QPixmap *VImageResourceManager2::fetchImage(const QString &p_name)
+{
+    SharedImage *img = const_cast<SharedImage *>(sharedImage(p_name));
+    if (!img) {
+        return NULL;
+    }
+
+    if (img->isEvicted()) {
+        ++s_misses;
+        return NULL;
+    }
+
+    if (s_paintPending) {
+        s_paintPending = false;
+        ++s_paintGeneration;
+    }
+
+    ++s_hits;
+    img->m_lastUse = ++s_tick;
+    img->m_paintGeneration = s_paintGeneration;
+    return &img->m_image;
+}
+
+void VImageResourceManager2::beginPaint()
+{
+    s_paintPending = true;
+}
+
+bool VImageResourceManager2::isRecentlyPainted(const SharedImage &p_image)
+{
+    return p_image.m_paintGeneration > 0
+           && p_image.m_paintGeneration >= s_paintGeneration - 1;
+}
+
+QSize VImageResourceManager2::imageSize(const QString &p_name) const
+{
+    const SharedImage *img = sharedImage(p_name);
+    if (img) {
+        return img->m_size;
+    }
+
+    return QSize();
+}
+
+QString VImageResourceManager2::takeReloadPath(const QString &p_name)
+{
+    // Only one of the managers sharing the image will reload it.
+    SharedImage *img = const_cast<SharedImage *>(sharedImage(p_name));
+    if (!img || !img->isEvicted() || img->m_reloading) {
+        return QString();
+    }
+
+    img->m_reloading = true;
+    return img->m_path;
+}
+
 void VImageResourceManager2::clear()
 {
+    for (auto const &key : m_images) {
+        unrefImage(key);
+    }
+
     m_images.clear();
 }
 
 void VImageResourceManager2::removeImage(const QString &p_name)
 {
-    m_images.remove(p_name);
+    auto it = m_images.find(p_name);
+    if (it != m_images.end()) {
+        QString key = it.value();
+        m_images.erase(it);
+        unrefImage(key);
+    }
+}
+
+void VImageResourceManager2::evict(SharedImage &p_image)
+{
+    s_usedBytes -= p_image.m_cost;
+    p_image.m_cost = 0;
+    p_image.m_image = QPixmap();
+    p_image.m_reloading = false;
+    ++s_evictions;
+}
+
+void VImageResourceManager2::evictToFitBudget()
+{
+    if (s_budget <= 0 || s_usedBytes <= s_budget) {
+        return;
+    }
+
+    int nrEvicted = 0;
+    while (s_usedBytes > s_budget) {
+        // Find the least recently used one.
+        // The number of images is small, so just scan them.
+        SharedImage *lru = NULL;
+        for (auto it = s_images.begin(); it != s_images.end(); ++it) {
+            SharedImage &img = it.value();
+            // Never evict the newest one or the visible ones to avoid
+            // reloading them again and again. Private ones, such as frames of
+            // animated images, are counted but could not be reloaded.
+            if (img.isEvicted()
+                || img.m_path.isEmpty()
+                || img.m_lastUse == s_tick
+                || isRecentlyPainted(img)) {
+                continue;
+            }
+
+            if (!lru || img.m_lastUse < lru->m_lastUse) {
+                lru = &img;
+            }
+        }
+
+        if (!lru) {
+            break;
+        }
+
+        evict(*lru);
+        ++nrEvicted;
+    }
+
+    if (nrEvicted > 0) {
+        qDebug() << "preview image evicted" << nrEvicted << "pixmaps"
+                 << "hits" << s_hits << "misses" << s_misses
+                 << "evictions" << s_evictions
+                 << "images" << s_images.size()
+                 << "used" << s_usedBytes << "/" << s_budget;
+    }
+}
+
+void VImageResourceManager2::setBudget(qint64 p_budget)
+{
+    s_budget = p_budget;
+    evictToFitBudget();
+}
+
+qint64 VImageResourceManager2::estimateCost(const QPixmap &p_image)
+{
+    return (qint64)p_image.width() * p_image.height() * qMax(p_image.depth(), 8) / 8;
 }
@@ -4,30 +4,215 @@
 #include <QHash>
 #include <QString>
 #include <QPixmap>
+#include <QImage>
+#include <QPoint>
+#include <QSize>
 
 
+// Images of an editor.
+// Pixmaps are held in a process-wide reference-counted store keyed by the
+// canonical path, the modified time and the size of the image, so an image
+// previewed in several editors is decoded and held only once.
+// The store has a memory budget. The least recently drawn pixmaps are evicted
+// when the budget is exceeded and should be reloaded from their files on demand.
+// Pixmaps drawn in the current or the last paint are never evicted, even if
+// the budget is exceeded for a while.
 class VImageResourceManager2
 {
 public:
     VImageResourceManager2();
 
+    ~VImageResourceManager2();
+
     // Add an image to the resource with @p_name as the key.
     // If @p_name already exists in the resources, it will update it.
-    void addImage(const QString &p_name, const QPixmap &p_image);
+    // @p_path: the local file or the URL of the image to share it with other
+    // managers and to reload it from after eviction. Empty if the image could
+    // not be shared or evicted, though it still counts against the budget.
+    void addImage(const QString &p_name,
+                  const QPixmap &p_image,
+                  const QString &p_path = QString());
+
+    // Add image @p_name by sharing the image of local file @p_path of size
+    // @p_size if it is already held by any manager.
+    // Return false if there is no such image.
+    bool addSharedImage(const QString &p_name, const QString &p_path, const QSize &p_size);
+
+    // Paint @p_tile at @p_pos on image @p_name in place, which is used to fill
+    // an image progressively.
+    // Return false if it does not exist or is evicted.
+    bool paintImage(const QString &p_name, const QPoint &p_pos, const QImage &p_tile);
+
+    // Share image @p_name as the image of local file @p_path with other
+    // managers, such as after it has been filled progressively.
+    // Return false if it does not exist or is evicted.
+    bool shareImage(const QString &p_name, const QString &p_path);
 
     // Remove image @p_name.
     void removeImage(const QString &p_name);
 
     // Whether the resources contains image with name @p_name.
+    // True for evicted images.
     bool contains(const QString &p_name) const;
 
+    // Return NULL if not exists or evicted.
     const QPixmap *findImage(const QString &p_name) const;
 
+    // Like findImage() but mark it as the most recently used one and as drawn
+    // in the current paint.
+    // Used when drawing the image.
+    const QPixmap *fetchImage(const QString &p_name);
+
+    // Size of image @p_name, which is valid for evicted images too.
+    QSize imageSize(const QString &p_name) const;
+
+    // Return the file or URL to reload image @p_name from if it is evicted and
+    // not requested to reload yet. Otherwise, return empty.
+    // It is marked as being reloaded by this call.
+    QString takeReloadPath(const QString &p_name);
+
     void clear();
 
+    // Start a new paint of any editor.
+    // Only paints drawing any image count, so repaints of the cursor do not
+    // age the visible images.
+    static void beginPaint();
+
+    // Memory budget in bytes of the store.
+    static void setBudget(qint64 p_budget);
+
+    static qint64 budget();
+
+    // Estimated memory used by all the pixmaps in the store in bytes.
+    static qint64 usedBytes();
+
+    // Number of images in the store.
+    static int count();
+
+    static qint64 hits();
+
+    static qint64 misses();
+
+    static qint64 evictions();
+
 private:
-    // All the images resources.
-    QHash<QString, QPixmap> m_images;
+    // An image in the store.
+    struct SharedImage
+    {
+        SharedImage()
+            : m_cost(0),
+              m_lastUse(0),
+              m_paintGeneration(0),
+              m_reloading(false),
+              m_refs(0)
+        {
+        }
+
+        bool isEvicted() const
+        {
+            return m_image.isNull();
+        }
+
+        // Null if evicted.
+        QPixmap m_image;
+
+        QSize m_size;
+
+        // File or URL to reload the image from. Empty if it could not be evicted.
+        QString m_path;
+
+        // Estimated memory used by m_image in bytes.
+        qint64 m_cost;
+
+        // Tick of the last use.
+        qint64 m_lastUse;
+
+        // Generation of the last paint drawing it. 0 if never drawn.
+        qint64 m_paintGeneration;
+
+        // Whether it is requested to reload.
+        bool m_reloading;
+
+        // Number of names referring to it of all the managers.
+        int m_refs;
+    };
+
+    // Key in the store of image @p_name of this manager.
+    // @p_path: empty if the image could not be shared.
+    QString storeKey(const QString &p_name, const QString &p_path, const QSize &p_size) const;
+
+    // Refer @p_name to image @p_key in the store.
+    void bindImage(const QString &p_name, const QString &p_key);
+
+    // Image in the store @p_name refers to. NULL if not exists.
+    const SharedImage *sharedImage(const QString &p_name) const;
+
+    // Drop a reference to image @p_key in the store.
+    static void unrefImage(const QString &p_key);
+
+    // Release the pixmap of @p_image.
+    static void evict(SharedImage &p_image);
+
+    // Evict least recently used pixmaps until the budget is satisfied.
+    static void evictToFitBudget();
+
+    // Whether @p_image is drawn in the current or the last paint.
+    static bool isRecentlyPainted(const SharedImage &p_image);
+
+    static qint64 estimateCost(const QPixmap &p_image);
+
+    // Map from name to the key in the store.
+    QHash<QString, QString> m_images;
+
+    // The store of all the images of all the managers.
+    static QHash<QString, SharedImage> s_images;
+
+    static qint64 s_budget;
+
+    static qint64 s_usedBytes;
+
+    static qint64 s_tick;
+
+    // Generation of the current paint.
+    static qint64 s_paintGeneration;
+
+    // Whether a new paint has begun and not drawn any image yet.
+    static bool s_paintPending;
+
+    static qint64 s_hits;
+
+    static qint64 s_misses;
+
+    static qint64 s_evictions;
 };
 
+inline qint64 VImageResourceManager2::budget()
+{
+    return s_budget;
+}
+
+inline qint64 VImageResourceManager2::usedBytes()
+{
+    return s_usedBytes;
+}
+
+inline int VImageResourceManager2::count()
+{
+    return s_images.size();
+}
+
+inline qint64 VImageResourceManager2::hits()
+{
+    return s_hits;
+}
+
+inline qint64 VImageResourceManager2::misses()
+{
+    return s_misses;
+}
+
+inline qint64 VImageResourceManager2::evictions()
+{
+    return s_evictions;
+}
 #endif // VIMAGERESOURCEMANAGER2_H
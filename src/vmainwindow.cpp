@@ -204,6 +204,8 @@ void VMainWindow::setupUI()
             m_fileList, &VFileList::setDirectory);
     connect(directoryTree, &VDirectoryTree::directoryUpdated,
             editArea, &VEditArea::handleDirectoryUpdated);
+    connect(directoryTree, &VDirectoryTree::directoryReloaded,
+            m_fileList, &VFileList::handleDirectoryReloaded);
 
     connect(notebookSelector, &VNotebookSelector::notebookUpdated,
             editArea, &VEditArea::handleNotebookUpdated);
@@ -69,6 +69,12 @@ VMdEditor::VMdEditor(VFile *p_file,
             }
     });
 
+    // Let the highlighter highlight visible blocks first.
+    connect(verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &VMdEditor::updateVisibleBlockRange);
+    connect(verticalScrollBar(), &QScrollBar::rangeChanged,
+            this, &VMdEditor::updateVisibleBlockRange);
+
     m_cbHighlighter = new VCodeBlockHighlightHelper(m_mdHighlighter,
                                                     p_doc,
                                                     p_type);
@@ -78,6 +84,8 @@ VMdEditor::VMdEditor(VFile *p_file,
             m_previewMgr, &VPreviewManager::imageLinksUpdated);
     connect(m_previewMgr, &VPreviewManager::requestUpdateImageLinks,
             m_mdHighlighter, &HGMarkdownHighlighter::updateHighlight);
+    connect(this, &VTextEdit::requestReloadImage,
+            m_previewMgr, &VPreviewManager::reloadImage);
 
     m_editOps = new VMdEditOperations(this, m_file);
     connect(m_editOps, &VEditOperations::statusMessage,
@@ -155,6 +163,14 @@ void VMdEditor::reloadFile()
     setReadOnly(readonly);
 }
 
+void VMdEditor::updateVisibleBlockRange()
+{
+    QTextBlock firstBlock = firstVisibleBlock();
+    QTextBlock lastBlock = lastVisibleBlock();
+    m_mdHighlighter->setVisibleBlockRange(firstBlock.blockNumber(),
+                                          lastBlock.blockNumber());
+}
+
 bool VMdEditor::scrollToBlock(int p_blockNumber)
 {
     QTextBlock block = document()->findBlockByNumber(p_blockNumber);
@@ -642,6 +658,9 @@ void VMdEditor::clearUnusedImages()
                 qDebug() << "delete unused image" << unusedImages[i];
             }
         }
+
+        // Links to the deleted images could not be previewed any more.
+        m_previewMgr->invalidateImageLinks();
     }
 
     m_initImages.clear();
@@ -740,6 +759,9 @@ void VMdEditor::imageInserted(const QString &p_path)
     }
 
     m_insertedImages.append(link);
+
+    // Links to the new image may not be resolved before.
+    m_previewMgr->invalidateImageLinks();
 }
 
 bool VMdEditor::scrollToHeader(int p_blockNumber)
@@ -867,6 +889,8 @@ void VMdEditor::updateTextEditConfig()
 
     setImageWidthConstrainted(g_config->getEnablePreviewImageConstraint());
 
+    setLazyLayoutBlockThreshold(g_config->getLazyLayoutBlockThreshold());
+
     setLineLeading(m_config.m_lineDistanceHeight);
 
     setImageLineColor(g_config->getEditorPreviewImageLineFg());
@@ -185,6 +185,9 @@ private slots:
     // When there is no header in current cursor, will signal an invalid header.
     void updateCurrentHeader();
 
+    // Tell the highlighter which blocks are visible now.
+    void updateVisibleBlockRange();
+
 private:
     // Update the config of VTextEdit according to global configurations.
     void updateTextEditConfig();
@@ -1,6 +1,10 @@
 #include "vnotebook.h"
 #include <QDir>
+#include <QFileInfo>
 #include <QDebug>
+#include <QtConcurrent>
+#include <QFileSystemWatcher>
+#include <QTimer>
 #include "vdirectory.h"
 #include "utils/vutils.h"
 #include "vconfigmanager.h"
@@ -8,8 +12,18 @@
 
 extern VConfigManager *g_config;
 
+// Maximum number of directories to prefetch in one run.
+static const int c_maxPrefetchBatch = 100;
+
+// Maximum number of directories waiting to be prefetched.
+static const int c_maxPendingPrefetch = 1000;
+
+// Delay in ms to reload the directories changed outside after the last change.
+static const int c_reloadDelay = 500;
+
 VNotebook::VNotebook(const QString &name, const QString &path, QObject *parent)
-    : QObject(parent), m_name(name), m_valid(false)
+    : QObject(parent), m_name(name), m_valid(false),
+      m_prefetchGeneration(0), m_runningPrefetchGeneration(0)
 {
     m_path = QDir::cleanPath(path);
     m_recycleBinFolder = g_config->getRecycleBinFolder();
@@ -17,16 +31,41 @@ VNotebook::VNotebook(const QString &name, const QString &path, QObject *parent)
                                NULL,
                                VUtils::directoryNameFromPath(path),
                                QDateTime::currentDateTimeUtc());
+    m_index = new VNotebookIndex(m_path);
+
+    m_prefetchWatcher = new QFutureWatcher<QVector<VNotebookIndex::PrefetchedConfig>>(this);
+    connect(m_prefetchWatcher, &QFutureWatcher<QVector<VNotebookIndex::PrefetchedConfig>>::finished,
+            this, [this]() {
+                // Drop the results if the notebook has been closed meanwhile.
+                if (m_runningPrefetchGeneration == m_prefetchGeneration) {
+                    m_index->addPrefetchedConfigs(m_prefetchWatcher->result());
+                }
+
+                startPrefetch();
+            });
+
+    m_watcher = new QFileSystemWatcher(this);
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged,
+            this, &VNotebook::handleDirectoryChanged);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged,
+            this, &VNotebook::handleConfigFileChanged);
+
+    m_reloadTimer = new QTimer(this);
+    m_reloadTimer->setSingleShot(true);
+    m_reloadTimer->setInterval(c_reloadDelay);
+    connect(m_reloadTimer, &QTimer::timeout,
+            this, &VNotebook::reloadChangedDirectories);
 }
 
 VNotebook::~VNotebook()
 {
     delete m_rootDir;
+    delete m_index;
 }
 
 bool VNotebook::readConfigNotebook()
 {
-    QJsonObject configJson = VConfigManager::readDirectoryConfig(m_path);
+    QJsonObject configJson = readDirectoryConfig(m_path);
     if (configJson.isEmpty()) {
         qWarning() << "fail to read notebook configuration" << m_path;
         m_valid = false;
@@ -95,14 +134,14 @@ QJsonObject VNotebook::toConfigJson() const
 
 bool VNotebook::writeToConfig() const
 {
-    return VConfigManager::writeDirectoryConfig(m_path, toConfigJson());
+    return writeDirectoryConfig(m_path, toConfigJson());
 }
 
 bool VNotebook::writeConfigNotebook() const
 {
     QJsonObject nbJson = toConfigJsonNotebook();
 
-    QJsonObject configJson = VConfigManager::readDirectoryConfig(m_path);
+    QJsonObject configJson = readDirectoryConfig(m_path);
     if (configJson.isEmpty()) {
         qWarning() << "fail to read notebook configuration" << m_path;
         return false;
@@ -112,7 +151,7 @@ bool VNotebook::writeConfigNotebook() const
         configJson[it.key()] = it.value();
     }
 
-    return VConfigManager::writeDirectoryConfig(m_path, configJson);
+    return writeDirectoryConfig(m_path, configJson);
 }
 
 const QString &VNotebook::getName() const
@@ -128,6 +167,200 @@ const QString &VNotebook::getPath() const
 void VNotebook::close()
 {
     m_rootDir->close();
+
+    ++m_prefetchGeneration;
+    m_pendingPrefetchPaths.clear();
+    m_index->clearPrefetchedConfigs();
+
+    m_changedPaths.clear();
+    m_reloadTimer->stop();
+
+    m_index->flush();
+    m_index->save();
+}
+
+QJsonObject VNotebook::readDirectoryConfig(const QString &p_path) const
+{
+    return m_index->readDirectoryConfig(p_path);
+}
+
+bool VNotebook::writeDirectoryConfig(const QString &p_path, const QJsonObject &p_json) const
+{
+    return m_index->writeDirectoryConfig(p_path, p_json);
+}
+
+void VNotebook::prefetchDirectoryConfigs(const QStringList &p_paths)
+{
+    if (!g_config->getEnableDirectoryPrefetch()) {
+        return;
+    }
+
+    for (auto const &path : p_paths) {
+        if (m_pendingPrefetchPaths.size() >= c_maxPendingPrefetch) {
+            break;
+        }
+
+        QString cleanPath = QDir::cleanPath(path);
+        if (!m_index->isPrefetched(cleanPath)
+            && !m_pendingPrefetchPaths.contains(cleanPath)) {
+            m_pendingPrefetchPaths.append(cleanPath);
+        }
+    }
+
+    startPrefetch();
+}
+
+void VNotebook::startPrefetch()
+{
+    if (m_pendingPrefetchPaths.isEmpty() || m_prefetchWatcher->isRunning()) {
+        return;
+    }
+
+    QStringList paths = m_pendingPrefetchPaths.mid(0, c_maxPrefetchBatch);
+    m_pendingPrefetchPaths = m_pendingPrefetchPaths.mid(paths.size());
+
+    m_runningPrefetchGeneration = m_prefetchGeneration;
+    m_prefetchWatcher->setFuture(QtConcurrent::run(&VNotebookIndex::readDirectoryConfigs, paths));
+}
+
+void VNotebook::watchDirectory(VDirectory *p_dir)
+{
+    if (!g_config->getEnableNotebookWatcher()) {
+        return;
+    }
+
+    QString path = p_dir->fetchPath();
+    auto it = m_watchedDirs.find(path);
+    if (it != m_watchedDirs.end()) {
+        if (it.value() == p_dir) {
+            return;
+        }
+
+        // Another directory was renamed or moved away from this path.
+        m_watchedPaths.remove(it.value());
+        it.value() = p_dir;
+    } else {
+        m_watchedDirs.insert(path, p_dir);
+        if (!m_watcher->addPath(path)) {
+            qWarning() << "fail to watch folder" << path;
+        }
+
+        watchConfigFile(path);
+    }
+
+    m_watchedPaths.insert(p_dir, path);
+}
+
+void VNotebook::unwatchDirectory(VDirectory *p_dir)
+{
+    auto it = m_watchedPaths.find(p_dir);
+    if (it == m_watchedPaths.end()) {
+        return;
+    }
+
+    QString path = it.value();
+    m_watchedPaths.erase(it);
+    m_watchedDirs.remove(path);
+    m_watcher->removePath(path);
+
+    QString configFile = VConfigManager::getDirConfigFilePath(path);
+    if (m_watcher->files().contains(configFile)) {
+        m_watcher->removePath(configFile);
+    }
+}
+
+void VNotebook::watchConfigFile(const QString &p_path)
+{
+    QString configFile = VConfigManager::getDirConfigFilePath(p_path);
+    if (m_watcher->files().contains(configFile)
+        || !QFileInfo::exists(configFile)) {
+        return;
+    }
+
+    if (!m_watcher->addPath(configFile)) {
+        qWarning() << "fail to watch folder config file" << configFile;
+    }
+}
+
+void VNotebook::handleDirectoryChanged(const QString &p_path)
+{
+    m_changedPaths.insert(p_path);
+    m_reloadTimer->start();
+}
+
+void VNotebook::handleConfigFileChanged(const QString &p_file)
+{
+    QString path = QFileInfo(p_file).path();
+    if (!m_watchedDirs.contains(path)) {
+        return;
+    }
+
+    // The file is dropped from the watcher once it is replaced atomically.
+    watchConfigFile(path);
+
+    handleDirectoryChanged(path);
+}
+
+void VNotebook::reloadChangedDirectories()
+{
+    QSet<QString> paths;
+    paths.swap(m_changedPaths);
+
+    for (auto const &path : paths) {
+        // It may be removed by the reload of its parent.
+        VDirectory *dir = m_watchedDirs.value(path, NULL);
+        if (!dir || !dir->isOpened()) {
+            continue;
+        }
+
+        // The config file may be created or replaced since then.
+        watchConfigFile(path);
+
+        // Watch its new path if it is renamed or moved.
+        if (dir->fetchPath() != path) {
+            unwatchDirectory(dir);
+            watchDirectory(dir);
+        }
+
+        QVector<VDirectory *> removedDirs;
+        QVector<VNoteFile *> removedFiles;
+        if (!dir->reloadConfig(removedDirs, removedFiles)) {
+            continue;
+        }
+
+        emit directoryReloaded(dir);
+
+        // Views have dropped them.
+        for (auto subDir : removedDirs) {
+            subDir->close();
+            subDir->deleteLater();
+        }
+
+        for (auto file : removedFiles) {
+            file->deleteLater();
+        }
+    }
+}
+
+void VNotebook::prefetchRecentDirectories()
+{
+    QStringList paths;
+    QVector<VFileSessionInfo> files = g_config->getLastOpenedFiles();
+    for (auto const &file : files) {
+        QStringList parts;
+        if (!VUtils::splitPathInBasePath(m_path, file.m_file, parts) || parts.isEmpty()) {
+            continue;
+        }
+
+        // Skip the note itself.
+        QString path = m_path;
+        for (int i = 0; i < parts.size() - 1; ++i) {
+            path = QDir(path).filePath(parts[i]);
+            paths.append(path);
+        }
+    }
+
+    prefetchDirectoryConfigs(paths);
 }
 
 bool VNotebook::open()
@@ -142,7 +375,16 @@ bool VNotebook::open()
         }
     }
 
-    return m_rootDir->open();
+    bool opened = isOpened();
+    if (!m_rootDir->open()) {
+        return false;
+    }
+
+    if (!opened) {
+        prefetchRecentDirectories();
+    }
+
+    return true;
 }
 
 VNotebook *VNotebook::createNotebook(const QString &p_name,
@@ -215,6 +457,9 @@ bool VNotebook::deleteNotebook(VNotebook *p_notebook, bool p_deleteFiles)
             ret = false;
         }
 
+        // Write pending configs before deleting them.
+        VNotebookIndex::flushAll();
+
         // Delete the config file.
         if (!VConfigManager::deleteDirectoryConfig(p_notebook->getPath())) {
             ret = false;
@@ -4,10 +4,18 @@
 #include <QObject>
 #include <QString>
 #include <QDateTime>
+#include <QStringList>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QSet>
+
+#include "vnotebookindex.h"
 
 class VDirectory;
 class VFile;
 class VNoteFile;
+class QFileSystemWatcher;
+class QTimer;
 
 class VNotebook : public QObject
 {
@@ -95,7 +103,51 @@ public:
 
     bool isValid() const;
 
+    // Read the config of directory @p_path in this notebook.
+    QJsonObject readDirectoryConfig(const QString &p_path) const;
+
+    // Write @p_json to the config of directory @p_path in this notebook.
+    bool writeDirectoryConfig(const QString &p_path, const QJsonObject &p_json) const;
+
+    // Read the configs of directories @p_paths in background, which are likely
+    // to be opened next. They will be used when opening the directories.
+    void prefetchDirectoryConfigs(const QStringList &p_paths);
+
+    // Watch opened directory @p_dir and its config file for changes outside.
+    void watchDirectory(VDirectory *p_dir);
+
+    void unwatchDirectory(VDirectory *p_dir);
+
+signals:
+    // Emitted after the contents of opened directory @p_dir are reloaded since
+    // its config is changed outside.
+    // Removed sub-directories and files are still alive and will be deleted
+    // later.
+    void directoryReloaded(VDirectory *p_dir);
+
+private slots:
+    // Record the change and reload it after a short delay, which coalesces a
+    // burst of changes.
+    void handleDirectoryChanged(const QString &p_path);
+
+    // Config file @p_file of a watched directory is changed.
+    void handleConfigFileChanged(const QString &p_file);
+
+    // Reload the changed directories.
+    void reloadChangedDirectories();
+
 private:
+    // Watch the config file of directory @p_path if it is not watched.
+    // The watch is dropped once the file is replaced atomically.
+    void watchConfigFile(const QString &p_path);
+
+    // Start reading the pending directory configs if not busy.
+    void startPrefetch();
+
+    // Prefetch the configs of the directories on the paths of the recently
+    // opened notes within this notebook.
+    void prefetchRecentDirectories();
+
     // Serialize current instance to json.
     QJsonObject toConfigJson() const;
 
@@ -121,6 +173,34 @@ private:
     // Parent is NULL for root directory
     VDirectory *m_rootDir;
 
+    // Snapshot of the directory configs.
+    VNotebookIndex *m_index;
+
+    // Directories whose configs are waiting to be prefetched.
+    QStringList m_pendingPrefetchPaths;
+
+    QFutureWatcher<QVector<VNotebookIndex::PrefetchedConfig>> *m_prefetchWatcher;
+
+    // Increased when closed to drop the configs prefetched before.
+    int m_prefetchGeneration;
+
+    // Generation of the running prefetch.
+    int m_runningPrefetchGeneration;
+
+    QFileSystemWatcher *m_watcher;
+
+    // Watched path to the opened directory.
+    QHash<QString, VDirectory *> m_watchedDirs;
+
+    // Opened directory to its watched path, which may differ from its path
+    // once it is renamed or moved.
+    QHash<VDirectory *, QString> m_watchedPaths;
+
+    // Watched paths changed and not reloaded yet.
+    QSet<QString> m_changedPaths;
+
+    QTimer *m_reloadTimer;
+
     // Whether this notebook is valid.
     // Will set to true after readConfigNotebook().
     bool m_valid;
@@ -0,0 +1,379 @@
+#include "vnotebookindex.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QCryptographicHash>
+#include "vconfigmanager.h"
+
+extern VConfigManager *g_config;
+
+// Magic number and format version of the index file.
+static const quint32 c_indexFileMagic = 0x564e4958; // VNIX
+static const quint32 c_indexFileVersion = 1;
+
+int VNotebookIndex::s_batchDepth = 0;
+
+QSet<VNotebookIndex *> VNotebookIndex::s_pendingIndexes;
+
+VNotebookIndex::VNotebookIndex(const QString &p_notebookPath)
+    : m_notebookPath(p_notebookPath),
+      m_loaded(false),
+      m_dirty(false)
+{
+}
+
+VNotebookIndex::~VNotebookIndex()
+{
+    flush();
+    save();
+}
+
+QString VNotebookIndex::indexFilePath() const
+{
+    // The index is kept outside the notebook, which may be synced.
+    QByteArray hash = QCryptographicHash::hash(m_notebookPath.toUtf8(),
+                                               QCryptographicHash::Md5);
+    return QDir(g_config->getNotebookIndexFolder()).filePath(QString::fromLatin1(hash.toHex()) + ".index");
+}
+
+void VNotebookIndex::load()
+{
+    if (m_loaded) {
+        return;
+    }
+
+    m_loaded = true;
+
+    QFile file(indexFilePath());
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return;
+    }
+
+    // Map the file instead of reading it through many small reads.
+    uchar *data = file.map(0, file.size());
+    QByteArray raw;
+    if (data) {
+        raw = QByteArray::fromRawData((const char *)data, file.size());
+    } else {
+        raw = file.readAll();
+    }
+
+    QDataStream in(raw);
+    in.setVersion(QDataStream::Qt_5_6);
+
+    quint32 magic, version;
+    in >> magic >> version;
+    if (magic != c_indexFileMagic || version != c_indexFileVersion) {
+        qWarning() << "ignore notebook index file of unknown format" << file.fileName();
+        return;
+    }
+
+    qint32 nrEntries;
+    in >> nrEntries;
+    for (int i = 0; i < nrEntries && in.status() == QDataStream::Ok; ++i) {
+        QString path;
+        Entry entry;
+        in >> path >> entry.m_modifiedTime >> entry.m_size >> entry.m_data;
+        if (in.status() == QDataStream::Ok) {
+            m_entries.insert(path, entry);
+        }
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qWarning() << "notebook index file is corrupted" << file.fileName();
+    }
+
+    qDebug() << "load" << m_entries.size() << "entries of notebook index of" << m_notebookPath;
+}
+
+QJsonObject VNotebookIndex::readDirectoryConfig(const QString &p_path)
+{
+    QString path = QDir::cleanPath(p_path);
+
+    // Not written to disk yet.
+    auto wit = m_pendingWrites.constFind(path);
+    if (wit != m_pendingWrites.constEnd()) {
+        return wit.value();
+    }
+
+    auto pit = m_prefetchedConfigs.find(path);
+    if (pit != m_prefetchedConfigs.end()) {
+        PrefetchedConfig config = pit.value();
+        m_prefetchedConfigs.erase(pit);
+
+        QFileInfo fi(VConfigManager::getDirConfigFilePath(path));
+        if (fi.exists()
+            && fi.lastModified().toMSecsSinceEpoch() == config.m_modifiedTime
+            && fi.size() == config.m_size) {
+            if (g_config->getEnableNotebookIndex()) {
+                load();
+                updateEntry(path, config.m_json);
+            }
+
+            return config.m_json;
+        }
+    }
+
+    if (!g_config->getEnableNotebookIndex()) {
+        return VConfigManager::readDirectoryConfig(path);
+    }
+
+    load();
+
+    auto it = m_entries.find(path);
+    if (it != m_entries.end()) {
+        // Just check the time and size instead of reading the config file.
+        QFileInfo fi(VConfigManager::getDirConfigFilePath(path));
+        Entry &entry = it.value();
+        if (fi.exists()
+            && fi.lastModified().toMSecsSinceEpoch() == entry.m_modifiedTime
+            && fi.size() == entry.m_size) {
+            QJsonDocument doc = QJsonDocument::fromBinaryData(entry.m_data);
+            if (doc.isObject()) {
+                entry.m_used = true;
+                return doc.object();
+            }
+        }
+    }
+
+    QJsonObject json = VConfigManager::readDirectoryConfig(path);
+    if (!json.isEmpty()) {
+        updateEntry(path, json);
+    }
+
+    return json;
+}
+
+bool VNotebookIndex::writeDirectoryConfig(const QString &p_path, const QJsonObject &p_json)
+{
+    QString path = QDir::cleanPath(p_path);
+    m_prefetchedConfigs.remove(path);
+
+    if (s_batchDepth > 0) {
+        m_pendingWrites.insert(path, p_json);
+        s_pendingIndexes.insert(this);
+        return true;
+    }
+
+    m_pendingWrites.remove(path);
+
+    if (!VConfigManager::writeDirectoryConfig(path, p_json)) {
+        return false;
+    }
+
+    if (g_config->getEnableNotebookIndex()) {
+        load();
+        updateEntry(path, p_json);
+    }
+
+    return true;
+}
+
+bool VNotebookIndex::flush(const QString &p_dirPath)
+{
+    QHash<QString, QJsonObject> writes;
+    if (p_dirPath.isEmpty()) {
+        writes.swap(m_pendingWrites);
+    } else {
+        QString dirPath = QDir::cleanPath(p_dirPath);
+        QString prefix = dirPath + '/';
+        for (auto it = m_pendingWrites.begin(); it != m_pendingWrites.end();) {
+            if (it.key() == dirPath || it.key().startsWith(prefix)) {
+                writes.insert(it.key(), it.value());
+                it = m_pendingWrites.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    if (m_pendingWrites.isEmpty()) {
+        s_pendingIndexes.remove(this);
+    }
+
+    if (writes.isEmpty()) {
+        return true;
+    }
+
+    bool ret = true;
+    for (auto it = writes.constBegin(); it != writes.constEnd(); ++it) {
+        // The directory may be deleted within the batch.
+        if (!QFileInfo(it.key()).isDir()) {
+            qDebug() << "skip writing config of missing directory" << it.key();
+            continue;
+        }
+
+        if (!VConfigManager::writeDirectoryConfig(it.key(), it.value())) {
+            ret = false;
+            continue;
+        }
+
+        if (g_config->getEnableNotebookIndex()) {
+            load();
+            updateEntry(it.key(), it.value());
+        }
+    }
+
+    qDebug() << "flush" << writes.size() << "directory configs of notebook" << m_notebookPath;
+    return ret;
+}
+
+void VNotebookIndex::beginBatch()
+{
+    ++s_batchDepth;
+}
+
+bool VNotebookIndex::endBatch()
+{
+    Q_ASSERT(s_batchDepth > 0);
+    if (--s_batchDepth > 0) {
+        return true;
+    }
+
+    return flushAll();
+}
+
+bool VNotebookIndex::flushAll()
+{
+    bool ret = true;
+    // flush() will remove the index from s_pendingIndexes.
+    const QSet<VNotebookIndex *> indexes = s_pendingIndexes;
+    for (auto index : indexes) {
+        if (!index->flush()) {
+            ret = false;
+        }
+    }
+
+    return ret;
+}
+
+bool VNotebookIndex::flushDirectory(const QString &p_dirPath)
+{
+    bool ret = true;
+    const QSet<VNotebookIndex *> indexes = s_pendingIndexes;
+    for (auto index : indexes) {
+        if (!index->flush(p_dirPath)) {
+            ret = false;
+        }
+    }
+
+    return ret;
+}
+
+void VNotebookIndex::updateEntry(const QString &p_path, const QJsonObject &p_json)
+{
+    QFileInfo fi(VConfigManager::getDirConfigFilePath(p_path));
+    if (!fi.exists()) {
+        m_entries.remove(p_path);
+        return;
+    }
+
+    Entry &entry = m_entries[p_path];
+    entry.m_modifiedTime = fi.lastModified().toMSecsSinceEpoch();
+    entry.m_size = fi.size();
+    entry.m_data = QJsonDocument(p_json).toBinaryData();
+    entry.m_used = true;
+    m_dirty = true;
+}
+
+bool VNotebookIndex::save()
+{
+    if (!m_dirty) {
+        return true;
+    }
+
+    // Drop entries of directories which no longer exist.
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (!it.value().m_used
+            && !QFileInfo::exists(VConfigManager::getDirConfigFilePath(it.key()))) {
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    QString filePath = indexFilePath();
+    if (!QDir().mkpath(QFileInfo(filePath).path())) {
+        qWarning() << "fail to create folder of notebook index" << filePath;
+        return false;
+    }
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "fail to open notebook index file" << filePath;
+        return false;
+    }
+
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_6);
+
+    out << c_indexFileMagic << c_indexFileVersion << (qint32)m_entries.size();
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        const Entry &entry = it.value();
+        out << it.key() << entry.m_modifiedTime << entry.m_size << entry.m_data;
+    }
+
+    if (!file.commit()) {
+        qWarning() << "fail to write notebook index file" << filePath;
+        return false;
+    }
+
+    m_dirty = false;
+    qDebug() << "save" << m_entries.size() << "entries of notebook index of" << m_notebookPath;
+    return true;
+}
+
+void VNotebookIndex::addPrefetchedConfigs(const QVector<PrefetchedConfig> &p_configs)
+{
+    for (auto const &config : p_configs) {
+        m_prefetchedConfigs.insert(config.m_path, config);
+    }
+}
+
+bool VNotebookIndex::isPrefetched(const QString &p_path) const
+{
+    return m_prefetchedConfigs.contains(p_path);
+}
+
+void VNotebookIndex::clearPrefetchedConfigs()
+{
+    m_prefetchedConfigs.clear();
+}
+
+QVector<VNotebookIndex::PrefetchedConfig> VNotebookIndex::readDirectoryConfigs(const QStringList &p_paths)
+{
+    QVector<PrefetchedConfig> configs;
+    configs.reserve(p_paths.size());
+    for (auto const &path : p_paths) {
+        // Do not touch obsolete config files, which will be renamed in the
+        // GUI thread when read.
+        QFile file(VConfigManager::getDirConfigFilePath(path));
+        QFileInfo fi(file);
+        if (!fi.exists() || !file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        // Take the time and size before reading so a config changed meanwhile
+        // will be found obsolete.
+        PrefetchedConfig config;
+        config.m_path = path;
+        config.m_modifiedTime = fi.lastModified().toMSecsSinceEpoch();
+        config.m_size = fi.size();
+
+        QJsonDocument doc = QJsonDocument::fromJson(file.readAll());
+        if (!doc.isObject()) {
+            continue;
+        }
+
+        config.m_json = doc.object();
+        configs.append(config);
+    }
+
+    return configs;
+}
@@ -0,0 +1,148 @@
+#ifndef VNOTEBOOKINDEX_H
+#define VNOTEBOOKINDEX_H
+
+#include <QString>
+#include <QHash>
+#include <QSet>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QStringList>
+#include <QVector>
+
+// Binary snapshot of the configs of all the directories of a notebook, which
+// saves reading and parsing the JSON config file of each directory when
+// opening it.
+// The configs are stored as binary JSON in one file. An entry is valid only
+// if the modified time and the size of its config file are not changed.
+class VNotebookIndex
+{
+public:
+    // Config of a directory read in background.
+    struct PrefetchedConfig
+    {
+        PrefetchedConfig()
+            : m_modifiedTime(0),
+              m_size(0)
+        {
+        }
+
+        QString m_path;
+
+        QJsonObject m_json;
+
+        // Modified time in ms and size of the config file when it is read.
+        qint64 m_modifiedTime;
+
+        qint64 m_size;
+    };
+
+    // @p_notebookPath: root path of the notebook.
+    explicit VNotebookIndex(const QString &p_notebookPath);
+
+    ~VNotebookIndex();
+
+    // Read the config of directory @p_path, which is looked up in the index
+    // first.
+    QJsonObject readDirectoryConfig(const QString &p_path);
+
+    // Write @p_json to the config of directory @p_path and update the index.
+    bool writeDirectoryConfig(const QString &p_path, const QJsonObject &p_json);
+
+    // Save the index to disk if it is changed.
+    bool save();
+
+    // Write the pending configs of this notebook to disk.
+    // If @p_dirPath is not empty, only write the configs of directory
+    // @p_dirPath and its sub-directories.
+    bool flush(const QString &p_dirPath = QString());
+
+    // Defer writing directory configs until the outermost batch ends.
+    // Each call should be paired with endBatch().
+    static void beginBatch();
+
+    // Write the pending configs of all notebooks if it is the outermost batch.
+    // Returns false if any config fails to be written.
+    static bool endBatch();
+
+    // Write the pending configs of all notebooks to disk.
+    // Should be called before directories are copied, moved or deleted in disk.
+    static bool flushAll();
+
+    // Write the pending configs of directory @p_dirPath and its sub-directories
+    // to disk.
+    // Should be called before the directory is copied, moved or deleted in disk.
+    static bool flushDirectory(const QString &p_dirPath);
+
+    // Add the prefetched configs, which will be used by readDirectoryConfig()
+    // if their config files are not changed since then.
+    void addPrefetchedConfigs(const QVector<PrefetchedConfig> &p_configs);
+
+    // Whether the config of directory @p_path has been prefetched.
+    bool isPrefetched(const QString &p_path) const;
+
+    // Drop all the prefetched configs.
+    void clearPrefetchedConfigs();
+
+    // Read the configs of directories @p_paths.
+    // Thread-safe. It is called in a worker thread. Directories whose config
+    // file could not be read are skipped.
+    static QVector<PrefetchedConfig> readDirectoryConfigs(const QStringList &p_paths);
+
+private:
+    struct Entry
+    {
+        Entry()
+            : m_modifiedTime(0),
+              m_size(0),
+              m_used(false)
+        {
+        }
+
+        // Modified time in ms of the config file.
+        qint64 m_modifiedTime;
+
+        // Size of the config file.
+        qint64 m_size;
+
+        // Binary JSON of the config.
+        QByteArray m_data;
+
+        // Whether it is read or written in this session.
+        bool m_used;
+    };
+
+    // Load the index from disk if not loaded yet.
+    void load();
+
+    // Update the entry of @p_path with config @p_json.
+    void updateEntry(const QString &p_path, const QJsonObject &p_json);
+
+    QString indexFilePath() const;
+
+    QString m_notebookPath;
+
+    // Keyed by the path of the directory.
+    QHash<QString, Entry> m_entries;
+
+    // Prefetched configs keyed by the path of the directory, which are taken
+    // once read.
+    QHash<QString, PrefetchedConfig> m_prefetchedConfigs;
+
+    // Configs written within a batch and not written to disk yet, keyed by
+    // the path of the directory.
+    QHash<QString, QJsonObject> m_pendingWrites;
+
+    // Nesting level of the batches.
+    static int s_batchDepth;
+
+    // Indexes with pending writes.
+    static QSet<VNotebookIndex *> s_pendingIndexes;
+
+    bool m_loaded;
+
+    // Whether the index has been changed since loaded.
+    bool m_dirty;
+};
+
+
+#endif // VNOTEBOOKINDEX_H
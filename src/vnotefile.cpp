@@ -21,13 +21,27 @@ VNoteFile::VNoteFile(VDirectory *p_directory,
                      const QVector<VAttachment> &p_attachments)
     : VFile(p_directory, p_name, p_type, p_modifiable, p_createdTimeUtc, p_modifiedTimeUtc),
       m_attachmentFolder(p_attachmentFolder),
-      m_attachments(p_attachments)
+      m_attachments(p_attachments),
+      m_cachedPathGeneration(-1)
 {
 }
 
+void VNoteFile::updateCachedPaths() const
+{
+    if (m_cachedPathGeneration == VDirectory::cachedPathGeneration()) {
+        return;
+    }
+
+    const VDirectory *dir = getDirectory();
+    m_cachedPath = QDir(dir->fetchPath()).filePath(m_name);
+    m_cachedRelativePath = QDir(dir->fetchRelativePath()).filePath(m_name);
+    m_cachedPathGeneration = VDirectory::cachedPathGeneration();
+}
+
 QString VNoteFile::fetchPath() const
 {
-    return QDir(getDirectory()->fetchPath()).filePath(m_name);
+    updateCachedPaths();
+    return m_cachedPath;
 }
 
 QString VNoteFile::fetchBasePath() const
@@ -54,6 +68,7 @@ QString VNoteFile::getImageFolderInLink() const
 void VNoteFile::setName(const QString &p_name)
 {
     m_name = p_name;
+    VDirectory::invalidateCachedPaths();
 }
 
 bool VNoteFile::rename(const QString &p_name)
@@ -74,11 +89,11 @@ bool VNoteFile::rename(const QString &p_name)
         return false;
     }
 
-    m_name = p_name;
+    setName(p_name);
 
     // Update parent directory's config file.
     if (!dir->updateFileConfig(this)) {
-        m_name = oldName;
+        setName(oldName);
         diskDir.rename(p_name, m_name);
         return false;
     }
@@ -122,7 +137,8 @@ QString VNoteFile::getNotebookName() const
 
 QString VNoteFile::fetchRelativePath() const
 {
-    return QDir(getDirectory()->fetchRelativePath()).filePath(m_name);
+    updateCachedPaths();
+    return m_cachedRelativePath;
 }
 
 VNoteFile *VNoteFile::fromJson(VDirectory *p_directory,
@@ -150,6 +166,40 @@ VNoteFile *VNoteFile::fromJson(VDirectory *p_directory,
                          attachments);
 }
 
+bool VNoteFile::updateConfig(const QJsonObject &p_json)
+{
+    QDateTime createdTime = QDateTime::fromString(p_json[DirConfig::c_createdTime].toString(),
+                                                  Qt::ISODate);
+    QDateTime modifiedTime = QDateTime::fromString(p_json[DirConfig::c_modifiedTime].toString(),
+                                                   Qt::ISODate);
+    QString attachmentFolder = p_json[DirConfig::c_attachmentFolder].toString();
+
+    QJsonArray attachmentJson = p_json[DirConfig::c_attachments].toArray();
+    QVector<VAttachment> attachments;
+    for (int i = 0; i < attachmentJson.size(); ++i) {
+        QJsonObject attachmentItem = attachmentJson[i].toObject();
+        attachments.push_back(VAttachment(attachmentItem[DirConfig::c_name].toString()));
+    }
+
+    bool changed = createdTime != m_createdTimeUtc
+                   || modifiedTime != m_modifiedTimeUtc
+                   || attachmentFolder != m_attachmentFolder
+                   || attachments.size() != m_attachments.size();
+    for (int i = 0; !changed && i < attachments.size(); ++i) {
+        changed = attachments[i].m_name != m_attachments[i].m_name;
+    }
+
+    if (!changed) {
+        return false;
+    }
+
+    m_createdTimeUtc = createdTime;
+    m_modifiedTimeUtc = modifiedTime;
+    m_attachmentFolder = attachmentFolder;
+    m_attachments = attachments;
+    return true;
+}
+
 QJsonObject VNoteFile::toConfigJson() const
 {
     QJsonObject item;
@@ -108,6 +108,11 @@ public:
     // Return the missing attachments' names.
     QVector<QString> checkAttachments();
 
+    // Update the times and attachments from @p_json Json object, which is
+    // the config of this file changed outside.
+    // Return true if anything is changed.
+    bool updateConfig(const QJsonObject &p_json);
+
     // Create a VNoteFile from @p_json Json object.
     static VNoteFile *fromJson(VDirectory *p_directory,
                                const QJsonObject &p_json,
@@ -137,12 +142,22 @@ private:
     // Delete this file in disk as well as all its images/attachments.
     bool deleteFile(QString *p_msg = NULL);
 
+    // Re-compute the cached paths from the directory if they are obsolete.
+    void updateCachedPaths() const;
+
     // Folder under the attachment folder of the notebook.
     // Store all the attachments of current file.
     QString m_attachmentFolder;
 
     // Attachments.
     QVector<VAttachment> m_attachments;
+
+    // Cached absolute path and path relative to the notebook.
+    mutable QString m_cachedPath;
+    mutable QString m_cachedRelativePath;
+
+    // See VDirectory::cachedPathGeneration().
+    mutable int m_cachedPathGeneration;
 };
 
 inline const QString &VNoteFile::getAttachmentFolder() const
@@ -0,0 +1,268 @@
+#include "vpegparser.h"
+
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+
+VPegParserWorker::VPegParserWorker(QObject *p_parent)
+    : QObject(p_parent),
+      m_arena(pmh_arena_new())
+{
+}
+
+VPegParserWorker::~VPegParserWorker()
+{
+    pmh_arena_free(m_arena);
+    m_arena = NULL;
+}
+
+void VPegParserWorker::parse(const QSharedPointer<VPegParseConfig> &p_config)
+{
+    QSharedPointer<VPegParseResult> result(new VPegParseResult(*p_config));
+
+    // Convert the raw text into plain text like QTextDocument::toPlainText()
+    // and record the start position of each block.
+    QString text = p_config->m_text;
+    QVector<int> blockPositions;
+    blockPositions.reserve(p_config->m_numOfBlocks);
+    blockPositions.append(0);
+    QChar *data = text.data();
+    for (int i = 0; i < text.size(); ++i) {
+        switch (data[i].unicode()) {
+        case QChar::ParagraphSeparator:
+            blockPositions.append(i + 1);
+            data[i] = QLatin1Char('\n');
+            break;
+
+        case QChar::LineSeparator:
+        case 0xfdd0: // QTextBeginningOfFrame
+        case 0xfdd1: // QTextEndOfFrame
+            data[i] = QLatin1Char('\n');
+            break;
+
+        case QChar::Nbsp:
+            data[i] = QLatin1Char(' ');
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (blockPositions.size() > p_config->m_numOfBlocks) {
+        blockPositions.resize(p_config->m_numOfBlocks);
+    }
+
+    result->m_endPos = p_config->m_offset + text.size();
+    result->m_blockHighlights.resize(p_config->m_numOfBlocks);
+
+    QByteArray ba = text.toUtf8();
+    if (!ba.isEmpty()) {
+        pmh_element **elements = NULL;
+        pmh_markdown_to_elements_in_arena(ba.data(), pmh_EXT_NONE, m_arena, &elements);
+
+        initBlockHighlightFromResult(elements,
+                                     text,
+                                     blockPositions,
+                                     p_config->m_styleTypes,
+                                     result->m_blockHighlights);
+
+        result->m_hasReferences = elements[pmh_REFERENCE] != NULL;
+
+        if (!p_config->m_fast) {
+            int offset = p_config->m_offset;
+            fetchRegionsFromResult(elements, pmh_COMMENT, text, offset, result->m_commentRegions);
+            fetchRegionsFromResult(elements, pmh_HTMLBLOCK, text, offset, result->m_htmlBlockRegions);
+            fetchRegionsFromResult(elements, pmh_IMAGE, text, offset, result->m_imageRegions);
+
+            pmh_element_type hx[6] = {pmh_H1, pmh_H2, pmh_H3, pmh_H4, pmh_H5, pmh_H6};
+            for (int i = 0; i < 6; ++i) {
+                fetchRegionsFromResult(elements, hx[i], text, offset, result->m_headerRegions);
+            }
+
+            std::sort(result->m_headerRegions.begin(), result->m_headerRegions.end());
+        }
+
+        // Release all the elements at once.
+        pmh_arena_reset(m_arena);
+    }
+
+    emit parseFinished(result);
+}
+
+void VPegParserWorker::initBlockHighlightFromResult(pmh_element **p_elements,
+                                                    const QString &p_text,
+                                                    const QVector<int> &p_blockPositions,
+                                                    const QVector<pmh_element_type> &p_styleTypes,
+                                                    QVector<QVector<HLUnit> > &p_highlights) const
+{
+    int nrBlocks = qMin(p_blockPositions.size(), p_highlights.size());
+    if (nrBlocks == 0) {
+        return;
+    }
+
+    unsigned long textLen = p_text.size();
+    auto blockLength = [&p_blockPositions, nrBlocks, textLen](int p_idx) {
+        if (p_idx < nrBlocks - 1) {
+            return (unsigned long)(p_blockPositions[p_idx + 1] - p_blockPositions[p_idx]);
+        }
+
+        // Including the paragraph separator.
+        return textLen - p_blockPositions[p_idx] + 1;
+    };
+
+    auto findBlock = [&p_blockPositions, nrBlocks](unsigned long p_pos) {
+        auto it = std::upper_bound(p_blockPositions.begin(),
+                                   p_blockPositions.begin() + nrBlocks,
+                                   (int)p_pos);
+        return (int)(it - p_blockPositions.begin()) - 1;
+    };
+
+    for (int i = 0; i < p_styleTypes.size(); ++i) {
+        pmh_element_type type = p_styleTypes[i];
+        pmh_element *elem = p_elements[type];
+
+        // pmh_H1 to pmh_H6 is continuous.
+        bool isHeader = type >= pmh_H1 && type <= pmh_H6;
+
+        while (elem != NULL) {
+            // When the the highlight element is at the end of text, @end will
+            // exceed the text.
+            unsigned long pos = elem->pos;
+            unsigned long end = qMin(elem->end, textLen);
+            if (end <= pos) {
+                elem = elem->next;
+                continue;
+            }
+
+            // Check header. Skip those headers with no spaces after #s.
+            if (isHeader && !isValidHeader(p_text, pos, end)) {
+                elem = elem->next;
+                continue;
+            }
+
+            int startBlockNum = findBlock(pos);
+            int endBlockNum = findBlock(end);
+            for (int j = startBlockNum; j <= endBlockNum; ++j) {
+                unsigned long blockStartPos = p_blockPositions[j];
+                HLUnit unit;
+                if (j == startBlockNum) {
+                    unit.start = pos - blockStartPos;
+                    unit.length = (startBlockNum == endBlockNum) ?
+                                  (end - pos) : (blockLength(j) - unit.start);
+                } else if (j == endBlockNum) {
+                    unit.start = 0;
+                    unit.length = end - blockStartPos;
+                } else {
+                    unit.start = 0;
+                    unit.length = blockLength(j);
+                }
+
+                unit.styleIndex = i;
+
+                p_highlights[j].append(unit);
+            }
+
+            elem = elem->next;
+        }
+    }
+}
+
+void VPegParserWorker::fetchRegionsFromResult(pmh_element **p_elements,
+                                              pmh_element_type p_type,
+                                              const QString &p_text,
+                                              int p_offset,
+                                              QVector<VElementRegion> &p_regions) const
+{
+    bool isHeader = p_type >= pmh_H1 && p_type <= pmh_H6;
+    unsigned long textLen = p_text.size();
+    pmh_element *elem = p_elements[p_type];
+    while (elem != NULL) {
+        unsigned long end = qMin(elem->end, textLen);
+        if (end <= elem->pos
+            || (isHeader && !isValidHeader(p_text, elem->pos, end))) {
+            elem = elem->next;
+            continue;
+        }
+
+        p_regions.push_back(VElementRegion(elem->pos + p_offset, end + p_offset));
+
+        elem = elem->next;
+    }
+}
+
+bool VPegParserWorker::isValidHeader(const QString &p_text,
+                                     unsigned long p_pos,
+                                     unsigned long p_end) const
+{
+    // There must exist spaces after #s.
+    // No more than 6 #s.
+    int nrNumberSign = 0;
+    for (unsigned long i = p_pos; i < p_end && i < (unsigned long)p_text.size(); ++i) {
+        QChar ch = p_text[(int)i];
+        if (ch.isSpace()) {
+            return true;
+        } else if (ch == QChar('#')) {
+            if (++nrNumberSign > 6) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+
+VPegParser::VPegParser(QObject *p_parent)
+    : QObject(p_parent),
+      m_parsing(false)
+{
+    qRegisterMetaType<QSharedPointer<VPegParseConfig>>();
+    qRegisterMetaType<QSharedPointer<VPegParseResult>>();
+
+    m_thread = new QThread(this);
+    m_worker = new VPegParserWorker();
+    m_worker->moveToThread(m_thread);
+
+    connect(m_thread, &QThread::finished,
+            m_worker, &QObject::deleteLater);
+    connect(this, &VPegParser::requestParse,
+            m_worker, &VPegParserWorker::parse);
+    connect(m_worker, &VPegParserWorker::parseFinished,
+            this, &VPegParser::handleParseFinished);
+
+    m_thread->start();
+}
+
+VPegParser::~VPegParser()
+{
+    m_thread->quit();
+    m_thread->wait();
+}
+
+void VPegParser::parseAsync(const QSharedPointer<VPegParseConfig> &p_config)
+{
+    if (m_parsing) {
+        // The worker will parse it after current parse.
+        m_pendingConfig = p_config;
+        return;
+    }
+
+    m_parsing = true;
+    emit requestParse(p_config);
+}
+
+void VPegParser::handleParseFinished(const QSharedPointer<VPegParseResult> &p_result)
+{
+    m_parsing = false;
+
+    if (!m_pendingConfig.isNull()) {
+        QSharedPointer<VPegParseConfig> config = m_pendingConfig;
+        m_pendingConfig.clear();
+        parseAsync(config);
+    }
+
+    emit parseResultReady(p_result);
+}
@@ -0,0 +1,181 @@
+#ifndef VPEGPARSER_H
+#define VPEGPARSER_H
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QVector>
+#include <QString>
+
+#include "hgmarkdownhighlighter.h"
+
+QT_BEGIN_NAMESPACE
+class QThread;
+QT_END_NAMESPACE
+
+// Input of one parse of PEG Markdown Highlight.
+struct VPegParseConfig
+{
+    VPegParseConfig()
+        : m_timeStamp(0),
+          m_revision(0),
+          m_offset(0),
+          m_startBlock(0),
+          m_numOfBlocks(0),
+          m_fast(false)
+    {
+    }
+
+    // Timestamp of the parse request.
+    long long m_timeStamp;
+
+    // Revision of the document when @m_text is fetched.
+    int m_revision;
+
+    // Raw text to parse, with blocks separated by QChar::ParagraphSeparator.
+    QString m_text;
+
+    // Position of @m_text within the document.
+    int m_offset;
+
+    // Block number of the first block of @m_text.
+    int m_startBlock;
+
+    // Number of blocks of @m_text.
+    int m_numOfBlocks;
+
+    // Element type of each highlighting style.
+    // The index is the same as HLUnit.styleIndex.
+    QVector<pmh_element_type> m_styleTypes;
+
+    // Whether only the block highlights are needed.
+    bool m_fast;
+};
+
+// Output of one parse of PEG Markdown Highlight.
+// All the regions are in the position of the document.
+struct VPegParseResult
+{
+    explicit VPegParseResult(const VPegParseConfig &p_config)
+        : m_timeStamp(p_config.m_timeStamp),
+          m_revision(p_config.m_revision),
+          m_offset(p_config.m_offset),
+          m_endPos(p_config.m_offset),
+          m_startBlock(p_config.m_startBlock),
+          m_numOfBlocks(p_config.m_numOfBlocks),
+          m_fast(p_config.m_fast),
+          m_hasReferences(false)
+    {
+    }
+
+    long long m_timeStamp;
+
+    int m_revision;
+
+    // Position of the parsed text within the document.
+    int m_offset;
+
+    // End position of the parsed text within the document.
+    int m_endPos;
+
+    int m_startBlock;
+
+    int m_numOfBlocks;
+
+    bool m_fast;
+
+    // Highlights of each block of the parsed text.
+    QVector<QVector<HLUnit> > m_blockHighlights;
+
+    // Whether there are reference definitions in the parsed text.
+    bool m_hasReferences;
+
+    QVector<VElementRegion> m_commentRegions;
+
+    QVector<VElementRegion> m_htmlBlockRegions;
+
+    QVector<VElementRegion> m_imageRegions;
+
+    // Sorted by start position.
+    QVector<VElementRegion> m_headerRegions;
+};
+
+Q_DECLARE_METATYPE(QSharedPointer<VPegParseConfig>)
+Q_DECLARE_METATYPE(QSharedPointer<VPegParseResult>)
+
+
+// Worker living in the parse thread.
+class VPegParserWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit VPegParserWorker(QObject *p_parent = nullptr);
+
+    ~VPegParserWorker();
+
+public slots:
+    void parse(const QSharedPointer<VPegParseConfig> &p_config);
+
+signals:
+    void parseFinished(const QSharedPointer<VPegParseResult> &p_result);
+
+private:
+    // Init highlights of blocks from parse results.
+    // @p_blockPositions: start position of each block within @p_text.
+    void initBlockHighlightFromResult(pmh_element **p_elements,
+                                      const QString &p_text,
+                                      const QVector<int> &p_blockPositions,
+                                      const QVector<pmh_element_type> &p_styleTypes,
+                                      QVector<QVector<HLUnit> > &p_highlights) const;
+
+    // Fetch regions of element @p_type from parse results and append them
+    // to @p_regions, shifted by @p_offset.
+    void fetchRegionsFromResult(pmh_element **p_elements,
+                                pmh_element_type p_type,
+                                const QString &p_text,
+                                int p_offset,
+                                QVector<VElementRegion> &p_regions) const;
+
+    // Check if [p_pos, p_end) of @p_text is a valid header.
+    bool isValidHeader(const QString &p_text, unsigned long p_pos, unsigned long p_end) const;
+
+    // Memory of the parse results, reused across parses.
+    pmh_arena *m_arena;
+};
+
+
+// Run PEG Markdown Highlight in a background thread.
+// Used in the GUI thread.
+class VPegParser : public QObject
+{
+    Q_OBJECT
+public:
+    explicit VPegParser(QObject *p_parent = nullptr);
+
+    ~VPegParser();
+
+    // Parse @p_config in the background. If there is a parse running, @p_config
+    // will be parsed after it, replacing any config waiting before.
+    void parseAsync(const QSharedPointer<VPegParseConfig> &p_config);
+
+signals:
+    void parseResultReady(const QSharedPointer<VPegParseResult> &p_result);
+
+    // Internal use to queue a parse in the worker thread.
+    void requestParse(const QSharedPointer<VPegParseConfig> &p_config);
+
+private slots:
+    void handleParseFinished(const QSharedPointer<VPegParseResult> &p_result);
+
+private:
+    QThread *m_thread;
+
+    VPegParserWorker *m_worker;
+
+    // Whether the worker is parsing.
+    bool m_parsing;
+
+    // Config to parse after current parse.
+    QSharedPointer<VPegParseConfig> m_pendingConfig;
+};
+
+#endif // VPEGPARSER_H
@@ -5,24 +5,170 @@
 #include <QDir>
 #include <QUrl>
 #include <QVector>
+#include <QStringList>
+#include <QImageReader>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <QApplication>
+#include <QDesktopWidget>
+#include <QScrollBar>
+#include <QTimer>
+#include <QMovie>
+#include <QEvent>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QAtomicInt>
+#include <algorithm>
 #include "vconfigmanager.h"
 #include "utils/vutils.h"
 #include "vdownloader.h"
 #include "hgmarkdownhighlighter.h"
 
+#if QT_VERSION < QT_VERSION_CHECK(5, 10, 0)
+#if defined(Q_OS_WIN)
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+#endif
+
 extern VConfigManager *g_config;
 
+// Max total size in KB of the thumbnails, 0 for no limit.
+static int s_thumbnailCacheSize = 0;
+
+// Total size in KB of the thumbnails counted since last pruning.
+static QAtomicInt s_thumbnailsSize(0);
+
+// Whether the thumbnails are being pruned.
+static QAtomicInt s_pruningThumbnails(0);
+
+// Downloader of previewed images shared by all the editors, so requests of the
+// same image are coalesced and limited as a whole.
+static VDownloader *previewImageDownloader()
+{
+    static VDownloader *downloader = NULL;
+    if (!downloader) {
+        downloader = new VDownloader(qApp);
+
+        qint64 cacheSize = g_config->getPreviewImageDownloadCacheSize() * 1024LL;
+        if (cacheSize > 0) {
+            downloader->setDiskCache(g_config->getPreviewImageDownloadCacheFolder(),
+                                     cacheSize);
+        }
+
+        downloader->setMaxConcurrentRequests(g_config->getMaxConcurrentPreviewImageDownloads());
+    }
+
+    return downloader;
+}
+
+// Remove the least recently used thumbnails in @p_folder until their total
+// size is within @p_maxSize bytes.
+static void pruneThumbnails(const QString &p_folder, qint64 p_maxSize)
+{
+    // Sorted by modified time, newest first. Thumbnails are touched when used.
+    QFileInfoList files = QDir(p_folder).entryInfoList(QStringList() << "*.png",
+                                                       QDir::Files,
+                                                       QDir::Time);
+    qint64 size = 0;
+    int nrRemoved = 0;
+    for (auto const &fi : files) {
+        if (size + fi.size() > p_maxSize && QFile::remove(fi.absoluteFilePath())) {
+            ++nrRemoved;
+        } else {
+            size += fi.size();
+        }
+    }
+
+    s_thumbnailsSize.storeRelease((int)(size / 1024));
+    s_pruningThumbnails.storeRelease(0);
+
+    if (nrRemoved > 0) {
+        qDebug() << "removed" << nrRemoved << "preview image thumbnails of" << p_folder;
+    }
+}
+
+// Prune the thumbnails in @p_folder in background unless it is running.
+static void startPruneThumbnails(const QString &p_folder)
+{
+    if (s_thumbnailCacheSize <= 0 || !s_pruningThumbnails.testAndSetOrdered(0, 1)) {
+        return;
+    }
+
+    // Leave some room so it is not pruned again right after next write.
+    qint64 maxSize = s_thumbnailCacheSize * 1024LL;
+    QtConcurrent::run(pruneThumbnails, p_folder, maxSize - maxSize / 10);
+}
+
+// Prune the thumbnails of previewed images in background once per session to
+// count their size. They are pruned again once new ones exceed the limit.
+static void pruneThumbnailsOnce()
+{
+    static bool pruned = false;
+    if (pruned) {
+        return;
+    }
+
+    pruned = true;
+    s_thumbnailCacheSize = g_config->getPreviewImageThumbnailCacheSize();
+    if (g_config->getEnablePreviewImageThumbnail()) {
+        startPruneThumbnails(g_config->getPreviewImageThumbnailFolder());
+    }
+}
+
+// Mark thumbnail @p_path as the most recently used one.
+static void touchThumbnail(const QString &p_path)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+    QFile file(p_path);
+    if (file.open(QIODevice::ReadWrite)) {
+        file.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    }
+#else
+    utime(QFile::encodeName(p_path).constData(), NULL);
+#endif
+}
+
 VPreviewManager::VPreviewManager(VMdEditor *p_editor, HGMarkdownHighlighter *p_highlighter)
     : QObject(p_editor),
       m_editor(p_editor),
       m_document(p_editor->document()),
       m_highlighter(p_highlighter),
       m_previewEnabled(false),
-      m_timeStamp(0)
+      m_timeStamp(0),
+      m_linkCharCount(0),
+      m_dirtyStart(-1),
+      m_dirtyEnd(-1),
+      m_linksInvalidated(false)
 {
-    m_downloader = new VDownloader(this);
+    m_downloader = previewImageDownloader();
     connect(m_downloader, &VDownloader::downloadFinished,
             this, &VPreviewManager::imageDownloaded);
+
+    pruneThumbnailsOnce();
+
+    m_decodeTimer = new QTimer(this);
+    m_decodeTimer->setSingleShot(true);
+    m_decodeTimer->setInterval(100);
+    connect(m_decodeTimer, &QTimer::timeout,
+            this, &VPreviewManager::decodeNearImages);
+    connect(m_decodeTimer, &QTimer::timeout,
+            this, &VPreviewManager::updateAnimations);
+
+    m_editor->installEventFilter(this);
+
+    // Decode deferred images when they get near the viewport.
+    connect(m_editor->verticalScrollBar(), &QScrollBar::valueChanged,
+            m_decodeTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+    connect(m_editor->verticalScrollBar(), &QScrollBar::rangeChanged,
+            m_decodeTimer, static_cast<void (QTimer::*)()>(&QTimer::start));
+
+    connect(m_document, &QTextDocument::contentsChange,
+            this, &VPreviewManager::updateDirtyRange);
 }
 
 void VPreviewManager::imageLinksUpdated(const QVector<VElementRegion> &p_imageRegions)
@@ -32,9 +178,55 @@ void VPreviewManager::imageLinksUpdated(const QVector<VElementRegion> &p_imageRe
     }
 
     TS ts = ++m_timeStamp;
-    m_imageRegions = p_imageRegions;
+    previewImages(ts, p_imageRegions);
+}
+
+void VPreviewManager::updateImageLinks()
+{
+    if (!m_previewEnabled || m_dirtyStart >= 0) {
+        // Will be updated once the highlighter parses the changes.
+        return;
+    }
+
+    QVector<VElementRegion> regions;
+    regions.reserve(m_links.size());
+    for (auto const &link : m_links) {
+        regions.append(link.m_region);
+    }
+
+    TS ts = ++m_timeStamp;
+    previewImages(ts, regions);
+}
+
+void VPreviewManager::invalidateImageLinks()
+{
+    m_linksInvalidated = true;
+    updateImageLinks();
+}
+
+void VPreviewManager::updateDirtyRange(int p_position, int p_charsRemoved, int p_charsAdded)
+{
+    if (p_charsRemoved == 0 && p_charsAdded == 0) {
+        return;
+    }
+
+    int end = p_position + p_charsAdded;
+    if (m_dirtyStart < 0) {
+        m_dirtyStart = p_position;
+        m_dirtyEnd = end;
+        return;
+    }
+
+    // Map the end of current dirty range into the changed document.
+    int oldEnd = m_dirtyEnd;
+    if (oldEnd >= p_position + p_charsRemoved) {
+        oldEnd += p_charsAdded - p_charsRemoved;
+    } else if (oldEnd > p_position) {
+        oldEnd = end;
+    }
 
-    previewImages(ts);
+    m_dirtyStart = qMin(m_dirtyStart, p_position);
+    m_dirtyEnd = qMax(oldEnd, end);
 }
 
 void VPreviewManager::imageDownloaded(const QByteArray &p_data, const QString &p_url)
@@ -51,7 +243,7 @@ void VPreviewManager::imageDownloaded(const QByteArray &p_data, const QString &p
     QString name = it.value();
     m_urlToName.erase(it);
 
-    if (m_editor->containsImage(name) || name.isEmpty()) {
+    if (name.isEmpty()) {
         return;
     }
 
@@ -59,9 +251,502 @@ void VPreviewManager::imageDownloaded(const QByteArray &p_data, const QString &p
     image.loadFromData(p_data);
 
     if (!image.isNull()) {
-        m_editor->addImage(name, image);
+        // Evicted ones are reloaded via the disk cache of the downloader.
+        bool reloaded = m_editor->containsImage(name);
+        m_editor->addImage(name, image, p_url);
         qDebug() << "downloaded image inserted in resource manager" << p_url << name;
-        emit requestUpdateImageLinks();
+
+        if (reloaded) {
+            relayoutImageBlocks(name);
+        } else {
+            // Only links of this image need to be resolved again.
+            m_staleUrls.insert(name);
+            updateImageLinks();
+        }
+    }
+}
+
+// Path of the thumbnail of image @p_path downscaled to @p_size in @p_folder.
+// The name is the MD5 of the path, modified time, file size and the target
+// size of the image, so any change of them leads to a new thumbnail.
+static QString thumbnailPath(const QString &p_folder,
+                             const QString &p_path,
+                             const QSize &p_size)
+{
+    QFileInfo fi(p_path);
+    QString key = QString("%1\n%2\n%3\n%4x%5").arg(fi.absoluteFilePath())
+                                              .arg(fi.lastModified().toMSecsSinceEpoch())
+                                              .arg(fi.size())
+                                              .arg(p_size.width())
+                                              .arg(p_size.height());
+    QByteArray md5 = QCryptographicHash::hash(key.toUtf8(), QCryptographicHash::Md5);
+    return QDir(p_folder).filePath(QString::fromLatin1(md5.toHex()) + ".png");
+}
+
+// Decode image @p_path in a worker thread.
+// @p_size: size to downscale to. Invalid to keep the original size.
+// @p_thumbnailFolder: folder of the thumbnails of downscaled images. Empty to
+// disable the thumbnails.
+static QImage decodeImage(const QString &p_path,
+                          const QSize &p_size,
+                          const QString &p_thumbnailFolder)
+{
+    QString thumbnail;
+    if (p_size.isValid() && !p_thumbnailFolder.isEmpty()) {
+        thumbnail = thumbnailPath(p_thumbnailFolder, p_path, p_size);
+        QImage image(thumbnail);
+        if (image.size() == p_size) {
+            touchThumbnail(thumbnail);
+            return image;
+        }
+    }
+
+    QImageReader reader(p_path);
+    if (p_size.isValid()) {
+        reader.setScaledSize(p_size);
+    }
+
+    QImage image = reader.read();
+
+    if (!thumbnail.isEmpty() && !image.isNull()) {
+        // QSaveFile writes to a unique temporary file first, which avoids
+        // partial thumbnails when several threads decode the same image.
+        QSaveFile file(thumbnail);
+        if (QDir().mkpath(p_thumbnailFolder)
+            && file.open(QIODevice::WriteOnly)
+            && image.save(&file, "PNG")) {
+            qint64 size = file.size();
+            if (file.commit()) {
+                int total = s_thumbnailsSize.fetchAndAddOrdered((int)(size / 1024))
+                            + (int)(size / 1024);
+                if (s_thumbnailCacheSize > 0 && total > s_thumbnailCacheSize) {
+                    startPruneThumbnails(p_thumbnailFolder);
+                }
+            }
+        }
+    }
+
+    return image;
+}
+
+QSize VPreviewManager::decodeImageAsync(const QString &p_name,
+                                        const QString &p_path,
+                                        bool p_deferred)
+{
+    // Only read the header.
+    QImageReader reader(p_path);
+    QSize size = reader.size();
+    if (!size.isValid()) {
+        return QSize();
+    }
+
+    // No need to decode at a width larger than the screen.
+    QSize scaledSize;
+    if (g_config->getEnablePreviewImageConstraint()) {
+        int maxWidth = QApplication::desktop()->availableGeometry(m_editor).width();
+        if (maxWidth > 0 && size.width() > maxWidth) {
+            size.scale(maxWidth, size.height(), Qt::KeepAspectRatio);
+            scaledSize = size;
+        }
+    }
+
+    // Share the one decoded by any editor.
+    if (m_editor->addSharedImage(p_name, p_path, size)) {
+        return size;
+    }
+
+    if (p_deferred) {
+        m_deferredImages.insert(p_name, DeferredImage(p_path, size));
+        return size;
+    }
+
+    if (reader.supportsAnimation() && reader.imageCount() != 1) {
+        if (startAnimation(p_name, p_path, scaledSize)) {
+            return size;
+        }
+
+        return QSize();
+    }
+
+    m_pendingImages.insert(p_name, size);
+
+    QString thumbnailFolder;
+    if (g_config->getEnablePreviewImageThumbnail()) {
+        thumbnailFolder = g_config->getPreviewImageThumbnailFolder();
+    }
+
+    // Only formats which could decode part of the image are decoded in tiles.
+    // Otherwise the whole image would be decoded for each tile.
+    qint64 tilePixels = g_config->getPreviewImageTilePixels();
+    if (tilePixels > 0
+        && (qint64)size.width() * size.height() > tilePixels
+        && reader.supportsOption(scaledSize.isValid() ? QImageIOHandler::ScaledClipRect
+                                                      : QImageIOHandler::ClipRect)) {
+        decodeImageTilesAsync(p_name, p_path, size, scaledSize, thumbnailFolder);
+        return size;
+    }
+
+    QFutureWatcher<QImage> *watcher = new QFutureWatcher<QImage>(this);
+    connect(watcher, &QFutureWatcher<QImage>::finished,
+            this, [this, watcher, p_name, p_path]() {
+                imageDecoded(p_name, p_path, watcher->result());
+                watcher->deleteLater();
+            });
+
+    watcher->setFuture(QtConcurrent::run(decodeImage, p_path, scaledSize, thumbnailFolder));
+
+    return size;
+}
+
+// Decode image @p_path of size @p_size after decoding in bands of about one
+// mega pixels and deliver them via @p_channel, which is deleted when done.
+// Only one band is held at a time.
+// The thumbnail is used if there is one, but it is not written since the whole
+// image is never held.
+// @p_scaled: whether @p_size is downscaled from the original size.
+static void decodeImageTiles(VImageTileChannel *p_channel,
+                             const QString &p_path,
+                             const QSize &p_size,
+                             bool p_scaled,
+                             const QString &p_thumbnailFolder)
+{
+    const int tileHeight = qMax((1 << 20) / qMax(p_size.width(), 1), 1);
+
+    QImage thumbnail;
+    if (p_scaled && !p_thumbnailFolder.isEmpty()) {
+        QString path = thumbnailPath(p_thumbnailFolder, p_path, p_size);
+        thumbnail = QImage(path);
+        if (thumbnail.size() == p_size) {
+            touchThumbnail(path);
+        } else {
+            thumbnail = QImage();
+        }
+    }
+
+    bool succeeded = true;
+    for (int y = 0; y < p_size.height(); y += tileHeight) {
+        QRect band(0, y, p_size.width(), qMin(tileHeight, p_size.height() - y));
+        QImage tile;
+        if (!thumbnail.isNull()) {
+            tile = thumbnail.copy(band);
+        } else {
+            QImageReader reader(p_path);
+            if (p_scaled) {
+                reader.setScaledSize(p_size);
+                reader.setScaledClipRect(band);
+            } else {
+                reader.setClipRect(band);
+            }
+
+            tile = reader.read();
+        }
+
+        if (tile.isNull()) {
+            succeeded = false;
+            break;
+        }
+
+        emit p_channel->tileDecoded(band.topLeft(), tile);
+    }
+
+    emit p_channel->finished(succeeded);
+    p_channel->deleteLater();
+}
+
+void VPreviewManager::decodeImageTilesAsync(const QString &p_name,
+                                            const QString &p_path,
+                                            const QSize &p_size,
+                                            const QSize &p_scaledSize,
+                                            const QString &p_thumbnailFolder)
+{
+    // Tiles are queued to the GUI thread one by one instead of being kept in
+    // the result store of a future until it is destroyed.
+    VImageTileChannel *channel = new VImageTileChannel();
+    connect(channel, &VImageTileChannel::tileDecoded,
+            this, [this, p_name, p_size](const QPoint &p_pos, const QImage &p_tile) {
+                tileDecoded(p_name, p_size, p_pos, p_tile);
+            }, Qt::QueuedConnection);
+    connect(channel, &VImageTileChannel::finished,
+            this, [this, p_name, p_path](bool p_succeeded) {
+                tilesDecoded(p_name, p_path, p_succeeded);
+            }, Qt::QueuedConnection);
+
+    QtConcurrent::run(decodeImageTiles,
+                      channel,
+                      p_path,
+                      p_size,
+                      p_scaledSize.isValid(),
+                      p_thumbnailFolder);
+}
+
+void VPreviewManager::tileDecoded(const QString &p_name,
+                                  const QSize &p_size,
+                                  const QPoint &p_pos,
+                                  const QImage &p_tile)
+{
+    if (!m_previewEnabled || !m_pendingImages.contains(p_name)) {
+        // Obsolete.
+        return;
+    }
+
+    if (p_pos.y() == 0) {
+        // Keep it private until all the tiles are painted, so other editors
+        // never share an unfinished image.
+        QPixmap image(p_size);
+        image.fill(Qt::transparent);
+        m_editor->addImage(p_name, image);
+    }
+
+    // Fill it tile by tile in the GUI thread.
+    if (m_editor->paintImage(p_name, p_pos, p_tile)) {
+        m_editor->updateBlocks(imageBlocks(p_name));
+    }
+}
+
+void VPreviewManager::tilesDecoded(const QString &p_name,
+                                   const QString &p_path,
+                                   bool p_succeeded)
+{
+    if (!m_pendingImages.remove(p_name) || !m_previewEnabled) {
+        return;
+    }
+
+    if (!p_succeeded) {
+        qWarning() << "fail to decode image for preview" << p_name;
+        m_editor->removeImage(p_name);
+        return;
+    }
+
+    m_editor->shareImage(p_name, p_path);
+
+    relayoutImageBlocks(p_name);
+}
+
+bool VPreviewManager::startAnimation(const QString &p_name,
+                                     const QString &p_path,
+                                     const QSize &p_scaledSize)
+{
+    // Frames are decoded on demand by QImageReader. It is started or paused
+    // according to the visibility in updateAnimations().
+    QMovie *movie = new QMovie(p_path, QByteArray(), this);
+    movie->setCacheMode(QMovie::CacheNone);
+    if (p_scaledSize.isValid()) {
+        movie->setScaledSize(p_scaledSize);
+    }
+
+    connect(movie, &QMovie::frameChanged,
+            this, [this, movie, p_name]() {
+                // The frame is private to this editor.
+                m_editor->addImage(p_name, movie->currentPixmap());
+                m_editor->updateBlocks(imageBlocks(p_name));
+            });
+
+    m_animatedImages.insert(p_name, movie);
+
+    // Show the first frame as a static image.
+    if (!movie->jumpToFrame(0)) {
+        qWarning() << "fail to decode animated image for preview" << p_name;
+        stopAnimation(p_name);
+        return false;
+    }
+
+    m_decodeTimer->start();
+    return true;
+}
+
+void VPreviewManager::updateAnimations()
+{
+    for (auto it = m_animatedImages.constBegin(); it != m_animatedImages.constEnd(); ++it) {
+        QMovie *movie = it.value();
+        bool visible = false;
+        if (m_previewEnabled && m_editor->isVisible()) {
+            for (auto bn : imageBlocks(it.key())) {
+                if (isBlockNearViewport(bn)) {
+                    visible = true;
+                    break;
+                }
+            }
+        }
+
+        if (visible) {
+            if (movie->state() == QMovie::NotRunning) {
+                movie->start();
+            } else if (movie->state() == QMovie::Paused) {
+                movie->setPaused(false);
+            }
+        } else if (movie->state() == QMovie::Running) {
+            movie->setPaused(true);
+        }
+    }
+}
+
+void VPreviewManager::stopAnimation(const QString &p_name)
+{
+    QMovie *movie = m_animatedImages.take(p_name);
+    if (movie) {
+        movie->stop();
+        movie->deleteLater();
+    }
+}
+
+bool VPreviewManager::eventFilter(QObject *p_obj, QEvent *p_event)
+{
+    if (p_obj == m_editor
+        && (p_event->type() == QEvent::Show || p_event->type() == QEvent::Hide)) {
+        // Pause animations of hidden editors.
+        m_decodeTimer->start();
+    }
+
+    return QObject::eventFilter(p_obj, p_event);
+}
+
+void VPreviewManager::reloadImage(const QString &p_name, const QString &p_path)
+{
+    if (!m_previewEnabled || m_pendingImages.contains(p_name)) {
+        return;
+    }
+
+    if (!QFileInfo::exists(p_path)) {
+        // Downloaded image.
+        m_downloader->download(p_path);
+        m_urlToName.insert(p_path, p_name);
+        return;
+    }
+
+    if (decodeImageAsync(p_name, p_path).isValid()
+        && !m_pendingImages.contains(p_name)) {
+        // Reloaded by another editor.
+        relayoutImageBlocks(p_name);
+    }
+}
+
+void VPreviewManager::imageDecoded(const QString &p_name,
+                                   const QString &p_path,
+                                   const QImage &p_image)
+{
+    auto it = m_pendingImages.find(p_name);
+    if (it == m_pendingImages.end()) {
+        // Obsolete.
+        return;
+    }
+
+    m_pendingImages.erase(it);
+
+    if (!m_previewEnabled) {
+        return;
+    }
+
+    if (p_image.isNull()) {
+        qWarning() << "fail to decode image for preview" << p_name;
+        return;
+    }
+
+    m_editor->addImage(p_name, QPixmap::fromImage(p_image), p_path);
+
+    relayoutImageBlocks(p_name);
+}
+
+void VPreviewManager::relayoutImageBlocks(const QString &p_name)
+{
+    // The size is the same as the placeholder, so just relayout blocks
+    // previewing it to update them.
+    m_editor->relayout(imageBlocks(p_name));
+}
+
+QSet<int> VPreviewManager::imageBlocks(const QString &p_name) const
+{
+    QSet<int> blocks;
+    for (auto const &link : m_links) {
+        if (link.m_name != p_name) {
+            continue;
+        }
+
+        QTextBlock block = m_document->findBlock(link.m_region.m_startPos);
+        if (block.isValid()) {
+            blocks.insert(block.blockNumber());
+        }
+    }
+
+    return blocks;
+}
+
+QSize VPreviewManager::imageSize(const QString &p_name) const
+{
+    auto it = m_pendingImages.find(p_name);
+    if (it != m_pendingImages.end()) {
+        return it.value();
+    }
+
+    auto dit = m_deferredImages.find(p_name);
+    if (dit != m_deferredImages.end()) {
+        return dit.value().m_size;
+    }
+
+    return m_editor->imageSize(p_name);
+}
+
+bool VPreviewManager::nearViewportBlocks(int &p_first, int &p_last) const
+{
+    int screens = g_config->getPreviewImageDecodeScreens();
+    int first = m_highlighter->getFirstVisibleBlock();
+    int last = m_highlighter->getLastVisibleBlock();
+    if (screens <= 0 || first < 0 || last < first) {
+        return false;
+    }
+
+    // Blocks of images are tall, so do not let the margin be too small.
+    int margin = qMax(last - first + 1, 10) * screens;
+    p_first = first - margin;
+    p_last = last + margin;
+    return true;
+}
+
+bool VPreviewManager::isBlockNearViewport(int p_blockNumber) const
+{
+    int first, last;
+    if (!nearViewportBlocks(first, last)) {
+        return true;
+    }
+
+    return p_blockNumber >= first && p_blockNumber <= last;
+}
+
+void VPreviewManager::decodeNearImages()
+{
+    if (!m_previewEnabled || m_deferredImages.isEmpty()) {
+        return;
+    }
+
+    int start = 0;
+    int end = m_document->characterCount();
+    int first, last;
+    if (nearViewportBlocks(first, last)) {
+        start = m_document->findBlockByNumber(qMax(first, 0)).position();
+        QTextBlock lastBlock = m_document->findBlockByNumber(qMin(last, m_document->blockCount() - 1));
+        end = lastBlock.position() + lastBlock.length();
+    }
+
+    // Links are sorted by position, so only check those near the viewport.
+    auto it = std::lower_bound(m_links.constBegin(),
+                               m_links.constEnd(),
+                               start,
+                               [](const PreviewedLink &p_link, int p_pos) {
+                                   return p_link.m_region.m_startPos < p_pos;
+                               });
+    QSet<QString> names;
+    for (; it != m_links.constEnd() && it->m_region.m_startPos < end; ++it) {
+        if (m_deferredImages.contains(it->m_name)) {
+            names.insert(it->m_name);
+        }
+    }
+
+    for (auto const &name : names) {
+        DeferredImage img = m_deferredImages.take(name);
+        if (decodeImageAsync(name, img.m_path).isValid()
+            && !m_pendingImages.contains(name)) {
+            // Shared by another editor.
+            relayoutImageBlocks(name);
+        }
     }
 }
 
@@ -80,95 +765,177 @@ void VPreviewManager::setPreviewEnabled(bool p_enabled)
 
 void VPreviewManager::clearPreview()
 {
-    m_imageRegions.clear();
-
     long long ts = ++m_timeStamp;
 
     for (int i = 0; i < (int)PreviewSource::MaxNumberOfSources; ++i) {
         clearBlockObsoletePreviewInfo(ts, static_cast<PreviewSource>(i));
+    }
 
-        clearObsoleteImages(ts, static_cast<PreviewSource>(i));
+    for (auto it = m_imageRefs.constBegin(); it != m_imageRefs.constEnd(); ++it) {
+        m_editor->removeImage(it.key());
     }
-}
 
-void VPreviewManager::previewImages(TS p_timeStamp)
-{
-    QVector<ImageLinkInfo> imageLinks;
-    fetchImageLinksFromRegions(imageLinks);
+    m_imageRefs.clear();
 
-    updateBlockPreviewInfo(p_timeStamp, imageLinks);
+    m_links.clear();
 
-    clearBlockObsoletePreviewInfo(p_timeStamp, PreviewSource::ImageLink);
+    m_staleUrls.clear();
 
-    clearObsoleteImages(p_timeStamp, PreviewSource::ImageLink);
-}
+    m_linksInvalidated = false;
 
-// Returns true if p_text[p_start, p_end) is all spaces.
-static bool isAllSpaces(const QString &p_text, int p_start, int p_end)
-{
-    int len = qMin(p_text.size(), p_end);
-    for (int i = p_start; i < len; ++i) {
-        if (!p_text[i].isSpace()) {
-            return false;
-        }
+    m_dirtyStart = m_dirtyEnd = -1;
+
+    m_pendingImages.clear();
+
+    m_deferredImages.clear();
+
+    for (auto movie : m_animatedImages) {
+        movie->stop();
+        movie->deleteLater();
     }
 
-    return true;
+    m_animatedImages.clear();
 }
 
-void VPreviewManager::fetchImageLinksFromRegions(QVector<ImageLinkInfo> &p_imageLinks)
+void VPreviewManager::previewImages(TS p_timeStamp, const QVector<VElementRegion> &p_imageRegions)
 {
-    p_imageLinks.clear();
+    int nrChar = m_document->characterCount();
+    int charDelta = nrChar - m_linkCharCount;
+
+    // Range [start, end) of current document changed since last time, expanded
+    // to whole blocks. Links after it are only shifted by @charDelta.
+    int start = nrChar;
+    int end = nrChar;
+    if (m_dirtyStart >= 0) {
+        int dirtyEnd = qBound(0, m_dirtyEnd, nrChar - 1);
+        int dirtyStart = qBound(0, m_dirtyStart, dirtyEnd);
+        start = m_document->findBlock(dirtyStart).position();
+        QTextBlock endBlock = m_document->findBlock(dirtyEnd);
+        end = endBlock.position() + endBlock.length();
+    }
 
-    if (m_imageRegions.isEmpty()) {
-        return;
+    int oldEnd = end - charDelta;
+
+    // The image files are looked up relative to the note.
+    QString basePath = m_editor->getFile()->fetchBasePath();
+    if (basePath != m_linkBasePath) {
+        m_linksInvalidated = true;
     }
 
-    p_imageLinks.reserve(m_imageRegions.size());
+    QVector<PreviewedLink> links(p_imageRegions.size());
+    for (int i = 0; i < p_imageRegions.size(); ++i) {
+        links[i].m_region = p_imageRegions[i];
+    }
 
-    QTextDocument *doc = m_editor->document();
+    // Whether each link is the same as last time and could be reused.
+    QVector<bool> sameLinks(links.size(), false);
 
-    for (int i = 0; i < m_imageRegions.size(); ++i) {
-        VElementRegion &reg = m_imageRegions[i];
-        QTextBlock block = doc->findBlock(reg.m_startPos);
-        if (!block.isValid()) {
+    // Images of links removed or changed since last time.
+    QStringList removedImages;
+
+    // Positions of links added, removed or changed.
+    QVector<int> changedPos;
+
+    // Both are sorted by position, so match them in one pass.
+    int idx = 0;
+    for (auto const &old : m_links) {
+        VElementRegion reg = old.m_region;
+        if (reg.m_endPos <= start) {
+            // Before the changed range.
+        } else if (reg.m_startPos >= oldEnd) {
+            reg.m_startPos += charDelta;
+            reg.m_endPos += charDelta;
+        } else {
+            // Within the changed range whose blocks will be updated.
+            removedImages.append(old.m_name);
             continue;
         }
 
-        int blockStart = block.position();
-        int blockEnd = blockStart + block.length() - 1;
-        QString text = block.text();
-        Q_ASSERT(reg.m_endPos <= blockEnd);
-        ImageLinkInfo info(reg.m_startPos,
-                           reg.m_endPos,
-                           blockStart,
-                           block.blockNumber(),
-                           calculateBlockMargin(block));
-        if ((reg.m_startPos == blockStart
-             || isAllSpaces(text, 0, reg.m_startPos - blockStart))
-            && (reg.m_endPos == blockEnd
-                || isAllSpaces(text, reg.m_endPos - blockStart, blockEnd - blockStart))) {
-            // Image block.
-            info.m_isBlock = true;
-            info.m_linkUrl = fetchImagePathToPreview(text, info.m_linkShortUrl);
+        for (; idx < links.size() && links[idx].m_region.m_startPos < reg.m_startPos; ++idx) {
+            changedPos.append(links[idx].m_region.m_startPos);
+        }
+
+        if (idx < links.size()
+            && links[idx].m_region.m_startPos == reg.m_startPos
+            && links[idx].m_region.m_endPos == reg.m_endPos
+            && !m_linksInvalidated
+            && !m_staleUrls.contains(old.m_shortUrl)) {
+            links[idx].m_shortUrl = old.m_shortUrl;
+            links[idx].m_name = old.m_name;
+            sameLinks[idx] = true;
+            ++idx;
         } else {
-            // Inline image.
-            info.m_isBlock = false;
-            info.m_linkUrl = fetchImagePathToPreview(text.mid(reg.m_startPos - blockStart,
-                                                              reg.m_endPos - reg.m_startPos),
-                                                     info.m_linkShortUrl);
+            removedImages.append(old.m_name);
+            changedPos.append(reg.m_startPos);
         }
+    }
 
-        if (info.m_linkUrl.isEmpty()) {
-            continue;
+    for (; idx < links.size(); ++idx) {
+        changedPos.append(links[idx].m_region.m_startPos);
+    }
+
+    // Blocks to update, including those within the changed range which
+    // previewed images.
+    QSet<int> blockNumbers;
+    QVector<QTextBlock> blocks;
+    for (auto pos : changedPos) {
+        QTextBlock block = m_document->findBlock(pos);
+        if (block.isValid() && !blockNumbers.contains(block.blockNumber())) {
+            blockNumbers.insert(block.blockNumber());
+            blocks.append(block);
         }
+    }
 
-        p_imageLinks.append(info);
+    if (start < end) {
+        for (QTextBlock block = m_document->findBlock(start);
+             block.isValid() && block.position() < end;
+             block = block.next()) {
+            VTextBlockData *blockData = dynamic_cast<VTextBlockData *>(block.userData());
+            if (blockData
+                && !blockData->getPreviews().isEmpty()
+                && !blockNumbers.contains(block.blockNumber())) {
+                blockNumbers.insert(block.blockNumber());
+                blocks.append(block);
+            }
+        }
+    }
 
-        qDebug() << "image region" << i
-                 << info.m_startPos << info.m_endPos << info.m_blockNumber
-                 << info.m_linkShortUrl << info.m_linkUrl << info.m_isBlock;
+    QSet<int> affectedBlocks;
+    for (auto const &block : blocks) {
+        if (updateBlockPreviewInfo(p_timeStamp, block, links, sameLinks)) {
+            affectedBlocks.insert(block.blockNumber());
+        }
     }
+
+    m_links = links;
+    m_linkCharCount = nrChar;
+    m_dirtyStart = m_dirtyEnd = -1;
+    m_linkBasePath = basePath;
+    m_linksInvalidated = false;
+    m_staleUrls.clear();
+
+    // Images of the new links have been referenced already.
+    for (auto const &name : removedImages) {
+        unrefImage(name);
+    }
+
+    m_editor->relayout(affectedBlocks);
+
+    qDebug() << "image links" << m_links.size() << "updated blocks" << blocks.size()
+             << "images" << m_imageRefs.size();
+}
+
+// Returns true if p_text[p_start, p_end) is all spaces.
+static bool isAllSpaces(const QString &p_text, int p_start, int p_end)
+{
+    int len = qMin(p_text.size(), p_end);
+    for (int i = p_start; i < len; ++i) {
+        if (!p_text[i].isSpace()) {
+            return false;
+        }
+    }
+
+    return true;
 }
 
 QString VPreviewManager::fetchImageUrlToPreview(const QString &p_text)
@@ -188,9 +955,8 @@ QString VPreviewManager::fetchImageUrlToPreview(const QString &p_text)
     return regExp.capturedTexts()[2].trimmed();
 }
 
-QString VPreviewManager::fetchImagePathToPreview(const QString &p_text, QString &p_url)
+QString VPreviewManager::fetchImagePathFromUrl(const QString &p_url)
 {
-    p_url = fetchImageUrlToPreview(p_text);
     if (p_url.isEmpty()) {
         return p_url;
     }
@@ -231,29 +997,45 @@ QString VPreviewManager::imageResourceName(const ImageLinkInfo &p_link)
 {
     QString name = p_link.m_linkShortUrl;
     if (m_editor->containsImage(name)
+        || m_pendingImages.contains(name)
+        || m_animatedImages.contains(name)
         || name.isEmpty()) {
         return name;
     }
 
+    // Defer decoding images far away from the viewport.
+    bool deferred = !isBlockNearViewport(p_link.m_blockNumber);
+    auto it = m_deferredImages.find(name);
+    if (it != m_deferredImages.end()) {
+        if (deferred) {
+            return name;
+        }
+
+        m_deferredImages.erase(it);
+    }
+
     // Add it to the resource.
     QString imgPath = p_link.m_linkUrl;
     QFileInfo info(imgPath);
-    QPixmap image;
     if (info.exists()) {
-        // Local file.
-        image = QPixmap(imgPath);
+        // Local file. Decode it in a worker thread if its size could be known
+        // ahead for the placeholder.
+        if (decodeImageAsync(name, imgPath, deferred).isValid()) {
+            return name;
+        }
+
+        QPixmap image(imgPath);
+        if (!image.isNull()) {
+            m_editor->addImage(name, image, imgPath);
+            return name;
+        }
     } else {
         // URL. Try to download it.
         m_downloader->download(imgPath);
         m_urlToName.insert(imgPath, name);
     }
 
-    if (image.isNull()) {
-        return QString();
-    }
-
-    m_editor->addImage(name, image);
-    return name;
+    return QString();
 }
 
 int VPreviewManager::calculateBlockMargin(const QTextBlock &p_block)
@@ -294,53 +1076,122 @@ int VPreviewManager::calculateBlockMargin(const QTextBlock &p_block)
     return spaceWidth * nrSpaces;
 }
 
-void VPreviewManager::updateBlockPreviewInfo(TS p_timeStamp,
-                                             const QVector<ImageLinkInfo> &p_imageLinks)
+bool VPreviewManager::updateBlockPreviewInfo(TS p_timeStamp,
+                                             const QTextBlock &p_block,
+                                             QVector<PreviewedLink> &p_links,
+                                             const QVector<bool> &p_sameLinks)
 {
-    for (auto const & link : p_imageLinks) {
-        QTextBlock block = m_document->findBlockByNumber(link.m_blockNumber);
-        if (!block.isValid()) {
-            continue;
+    VTextBlockData *blockData = dynamic_cast<VTextBlockData *>(p_block.userData());
+    if (!blockData) {
+        return false;
+    }
+
+    int blockStart = p_block.position();
+    int blockEnd = blockStart + p_block.length() - 1;
+    QString text = p_block.text();
+    int padding = calculateBlockMargin(p_block);
+
+    // Links are sorted by position.
+    auto it = std::lower_bound(p_links.begin(),
+                               p_links.end(),
+                               blockStart,
+                               [](const PreviewedLink &p_link, int p_pos) {
+                                   return p_link.m_region.m_startPos < p_pos;
+                               });
+
+    QVector<VPreviewedImageInfo> images;
+    for (; it != p_links.end() && it->m_region.m_startPos < blockEnd; ++it) {
+        const VElementRegion &reg = it->m_region;
+        Q_ASSERT(reg.m_endPos <= blockEnd);
+        bool isBlock = (reg.m_startPos == blockStart
+                        || isAllSpaces(text, 0, reg.m_startPos - blockStart))
+                       && (reg.m_endPos == blockEnd
+                           || isAllSpaces(text, reg.m_endPos - blockStart, blockEnd - blockStart));
+
+        if (!p_sameLinks[it - p_links.begin()]) {
+            // Resolve the link.
+            QString linkText = isBlock ? text
+                                       : text.mid(reg.m_startPos - blockStart,
+                                                  reg.m_endPos - reg.m_startPos);
+            it->m_shortUrl = fetchImageUrlToPreview(linkText);
+
+            if (!m_linksInvalidated
+                && !m_staleUrls.contains(it->m_shortUrl)
+                && m_imageRefs.contains(it->m_shortUrl)) {
+                // Previewed by other links already.
+                it->m_name = it->m_shortUrl;
+            } else {
+                ImageLinkInfo info(reg.m_startPos,
+                                   reg.m_endPos,
+                                   blockStart,
+                                   p_block.blockNumber(),
+                                   padding);
+                info.m_isBlock = isBlock;
+                info.m_linkShortUrl = it->m_shortUrl;
+                info.m_linkUrl = fetchImagePathFromUrl(info.m_linkShortUrl);
+                it->m_name = info.m_linkUrl.isEmpty() ? QString() : imageResourceName(info);
+
+                qDebug() << "image link" << info.m_startPos << info.m_endPos
+                         << info.m_linkShortUrl << info.m_linkUrl << isBlock;
+            }
+
+            refImage(it->m_name);
         }
 
-        QString name = imageResourceName(link);
-        if (name.isEmpty()) {
+        if (it->m_name.isEmpty()) {
             continue;
         }
 
-        VTextBlockData *blockData = dynamic_cast<VTextBlockData *>(block.userData());
-        Q_ASSERT(blockData);
+        images.append(VPreviewedImageInfo(reg.m_startPos - blockStart,
+                                          reg.m_endPos - blockStart,
+                                          padding,
+                                          !isBlock,
+                                          it->m_name,
+                                          imageSize(it->m_name)));
+    }
 
+    // Skip blocks whose links are not changed.
+    if (blockData->hasSamePreviews(PreviewSource::ImageLink, images)) {
+        return false;
+    }
+
+    for (auto const &img : images) {
         VPreviewInfo *info = new VPreviewInfo(PreviewSource::ImageLink,
                                               p_timeStamp,
-                                              link.m_startPos - link.m_blockPos,
-                                              link.m_endPos - link.m_blockPos,
-                                              link.m_padding,
-                                              !link.m_isBlock,
-                                              name,
-                                              m_editor->imageSize(name));
+                                              img.m_startPos,
+                                              img.m_endPos,
+                                              img.m_padding,
+                                              img.m_inline,
+                                              img.m_imageName,
+                                              img.m_imageSize);
         blockData->insertPreviewInfo(info);
+    }
 
-        imageCache(PreviewSource::ImageLink).insert(name, p_timeStamp);
+    blockData->clearObsoletePreview(p_timeStamp, PreviewSource::ImageLink);
 
-        qDebug() << "block" << link.m_blockNumber
-                 << imageCache(PreviewSource::ImageLink).size()
-                 << blockData->toString();
-    }
+    qDebug() << "block" << p_block.blockNumber() << blockData->toString();
+    return true;
 }
 
-void VPreviewManager::clearObsoleteImages(long long p_timeStamp, PreviewSource p_source)
+void VPreviewManager::refImage(const QString &p_name)
 {
-    auto cache = imageCache(p_source);
+    if (!p_name.isEmpty()) {
+        ++m_imageRefs[p_name];
+    }
+}
 
-    for (auto it = cache.begin(); it != cache.end();) {
-        if (it.value() < p_timeStamp) {
-            m_editor->removeImage(it.key());
-            it = cache.erase(it);
-        } else {
-            ++it;
-        }
+void VPreviewManager::unrefImage(const QString &p_name)
+{
+    auto it = m_imageRefs.find(p_name);
+    if (it == m_imageRefs.end() || --it.value() > 0) {
+        return;
     }
+
+    m_imageRefs.erase(it);
+    m_editor->removeImage(p_name);
+    m_pendingImages.remove(p_name);
+    m_deferredImages.remove(p_name);
+    stopAnimation(p_name);
 }
 
 void VPreviewManager::clearBlockObsoletePreviewInfo(long long p_timeStamp,
@@ -348,7 +1199,15 @@ void VPreviewManager::clearBlockObsoletePreviewInfo(long long p_timeStamp,
 {
     QSet<int> affectedBlocks;
     QVector<int> obsoleteBlocks;
-    auto blocks = m_highlighter->getPossiblePreviewBlocks();
+    // Blocks previewing links may not be highlighted since then.
+    QSet<int> blocks = m_highlighter->getPossiblePreviewBlocks();
+    for (auto const &link : m_links) {
+        QTextBlock block = m_document->findBlock(link.m_region.m_startPos);
+        if (block.isValid()) {
+            blocks.insert(block.blockNumber());
+        }
+    }
+
     qDebug() << "possible preview blocks" << blocks;
     for (auto i : blocks) {
         QTextBlock block = m_document->findBlockByNumber(i);
@@ -6,15 +6,37 @@
 #include <QTextBlock>
 #include <QHash>
 #include <QVector>
+#include <QSet>
+#include <QPair>
+#include <QImage>
+#include <QSize>
+#include <QPoint>
 #include "hgmarkdownhighlighter.h"
 #include "vmdeditor.h"
 #include "vtextblockdata.h"
 
 class VDownloader;
+class QTimer;
+class QMovie;
 
 typedef long long TS;
 
 
+// Deliver the tiles of an image decoded in a worker thread to the GUI thread
+// via queued signals, so each tile is released once it is painted.
+// It is created in the GUI thread and deleted by the worker when done.
+class VImageTileChannel : public QObject
+{
+    Q_OBJECT
+signals:
+    // Tile @p_tile at @p_pos of the image is decoded.
+    void tileDecoded(const QPoint &p_pos, const QImage &p_tile);
+
+    // All tiles have been delivered.
+    void finished(bool p_succeeded);
+};
+
+
 class VPreviewManager : public QObject
 {
     Q_OBJECT
@@ -26,10 +48,18 @@ public:
     // Clear all the preview.
     void clearPreview();
 
+    // Resolve all the image links again, such as after images are inserted
+    // or deleted.
+    void invalidateImageLinks();
+
 public slots:
     // Image links were updated from the highlighter.
     void imageLinksUpdated(const QVector<VElementRegion> &p_imageRegions);
 
+    // Reload image @p_name from local file or URL @p_path since it has been
+    // evicted.
+    void reloadImage(const QString &p_name, const QString &p_path);
+
 signals:
     // Request highlighter to update image links.
     void requestUpdateImageLinks();
@@ -38,6 +68,21 @@ private slots:
     // Non-local image downloaded for preview.
     void imageDownloaded(const QByteArray &p_data, const QString &p_url);
 
+    // Decode deferred images near the viewport.
+    void decodeNearImages();
+
+    // Play animated images near the viewport and pause the others.
+    void updateAnimations();
+
+    // Track the range of the document changed since last update of links.
+    void updateDirtyRange(int p_position, int p_charsRemoved, int p_charsAdded);
+
+    // Local image decoded in a worker thread for preview.
+    void imageDecoded(const QString &p_name, const QString &p_path, const QImage &p_image);
+
+protected:
+    bool eventFilter(QObject *p_obj, QEvent *p_event) Q_DECL_OVERRIDE;
+
 private:
     struct ImageLinkInfo
     {
@@ -88,34 +133,131 @@ private:
         bool m_isBlock;
     };
 
-    // Start to preview images according to image links.
-    void previewImages(TS p_timeStamp);
+    struct DeferredImage
+    {
+        DeferredImage()
+        {
+        }
+
+        DeferredImage(const QString &p_path, const QSize &p_size)
+            : m_path(p_path),
+              m_size(p_size)
+        {
+        }
+
+        // Local file of the image.
+        QString m_path;
+
+        // Size of the image after decoding.
+        QSize m_size;
+    };
+
+    // An image link of last update.
+    struct PreviewedLink
+    {
+        VElementRegion m_region;
+
+        // Short URL within the () of ![]().
+        QString m_shortUrl;
 
-    // According to m_imageRegions, fetch the image link Url.
-    // @p_imageRegions: output.
-    void fetchImageLinksFromRegions(QVector<ImageLinkInfo> &p_imageLinks);
+        // Name of the image in the resource manager. Empty if not previewed.
+        QString m_name;
+    };
+
+    // Start to preview images according to image links @p_imageRegions.
+    // Only links added or changed since last time are resolved, and only
+    // blocks whose links are changed are updated.
+    void previewImages(TS p_timeStamp, const QVector<VElementRegion> &p_imageRegions);
+
+    // Update the links of last time without parsing, such as after some of
+    // them are invalidated.
+    void updateImageLinks();
 
     // Fetch the image link's URL if there is only one link.
     QString fetchImageUrlToPreview(const QString &p_text);
 
-    // Fetch teh image's full path if there is only one image link.
-    // @p_url: contains the short URL in ![]().
-    QString fetchImagePathToPreview(const QString &p_text, QString &p_url);
+    // Fetch the image's full path from short URL @p_url in ![]().
+    QString fetchImagePathFromUrl(const QString &p_url);
 
-    // Update the preview info of related blocks according to @p_imageLinks.
-    void updateBlockPreviewInfo(TS p_timeStamp, const QVector<ImageLinkInfo> &p_imageLinks);
+    // Update the preview info of block @p_block according to @p_links.
+    // Links not in @p_sameLinks are resolved.
+    // Returns true if the previews of the block are changed.
+    bool updateBlockPreviewInfo(TS p_timeStamp,
+                                const QTextBlock &p_block,
+                                QVector<PreviewedLink> &p_links,
+                                const QVector<bool> &p_sameLinks);
 
     // Get the name of the image in the resource manager.
     // Will add the image to the resource manager if not exists.
     // Returns empty if fail to add the image to the resource manager.
     QString imageResourceName(const ImageLinkInfo &p_link);
 
+    // Decode local image @p_path as @p_name in a worker thread.
+    // It is downscaled to fit in the screen if image constraint is enabled.
+    // The image is shared without decoding if any editor already holds it.
+    // @p_deferred: whether the decoding should be deferred until the link
+    // gets near the viewport.
+    // Returns the size of the image after decoding, or an invalid size if
+    // the size could not be read ahead.
+    QSize decodeImageAsync(const QString &p_name,
+                           const QString &p_path,
+                           bool p_deferred = false);
+
+    // Decode large local image @p_path as @p_name of size @p_size in a worker
+    // thread, which is decoded and delivered in bands and shown progressively.
+    // @p_scaledSize: the size to downscale to, or invalid to keep the size.
+    void decodeImageTilesAsync(const QString &p_name,
+                               const QString &p_path,
+                               const QSize &p_size,
+                               const QSize &p_scaledSize,
+                               const QString &p_thumbnailFolder);
+
+    // Tile @p_tile at @p_pos of image @p_name decoded in a worker thread.
+    // It is private to this editor until all the tiles are decoded.
+    void tileDecoded(const QString &p_name,
+                     const QSize &p_size,
+                     const QPoint &p_pos,
+                     const QImage &p_tile);
+
+    // All tiles of image @p_name have been decoded. It is then shared as
+    // the image of local file @p_path with other editors.
+    void tilesDecoded(const QString &p_name, const QString &p_path, bool p_succeeded);
+
+    // Preview animated image @p_path as @p_name, whose frames are decoded on
+    // demand when it is visible.
+    bool startAnimation(const QString &p_name,
+                        const QString &p_path,
+                        const QSize &p_scaledSize);
+
+    void stopAnimation(const QString &p_name);
+
+    // Blocks previewing image @p_name.
+    QSet<int> imageBlocks(const QString &p_name) const;
+
+    // Blocks [p_first, p_last] within the configured number of screens
+    // around the viewport.
+    // Returns false if all the blocks are considered near the viewport.
+    bool nearViewportBlocks(int &p_first, int &p_last) const;
+
+    // Whether block @p_blockNumber is within the configured number of screens
+    // around the viewport.
+    bool isBlockNearViewport(int p_blockNumber) const;
+
+    // Relayout blocks previewing image @p_name.
+    void relayoutImageBlocks(const QString &p_name);
+
+    // Size of image @p_name in the resource manager or being decoded.
+    QSize imageSize(const QString &p_name) const;
+
     // Calculate the block margin (prefix spaces) in pixels.
     int calculateBlockMargin(const QTextBlock &p_block);
 
-    QHash<QString, long long> &imageCache(PreviewSource p_source);
+    // Add a link previewing image @p_name.
+    void refImage(const QString &p_name);
 
-    void clearObsoleteImages(long long p_timeStamp, PreviewSource p_source);
+    // Remove a link previewing image @p_name. The image is removed from the
+    // resource manager if no link previews it.
+    void unrefImage(const QString &p_name);
 
     void clearBlockObsoletePreviewInfo(long long p_timeStamp, PreviewSource p_source);
 
@@ -125,26 +267,55 @@ private:
 
     HGMarkdownHighlighter *m_highlighter;
 
+    // Shared by all the editors.
     VDownloader *m_downloader;
 
     // Whether preview is enabled.
     bool m_previewEnabled;
 
-    // Regions of all the image links.
-    QVector<VElementRegion> m_imageRegions;
-
     // Map from URL to name in the resource manager.
     // Used for downloading images.
     QHash<QString, QString> m_urlToName;
 
     TS m_timeStamp;
 
-    // Used to discard obsolete images. One per each preview source.
-    QHash<QString, long long> m_imageCaches[(int)PreviewSource::MaxNumberOfSources];
-};
+    // Image links of last update sorted by position.
+    QVector<PreviewedLink> m_links;
 
-inline QHash<QString, long long> &VPreviewManager::imageCache(PreviewSource p_source)
-{
-    return m_imageCaches[(int)p_source];
-}
+    // Character count of the document at last update of links.
+    int m_linkCharCount;
+
+    // Character range [m_dirtyStart, m_dirtyEnd) of current document which has
+    // been changed since last update of links. -1 if there is no change.
+    int m_dirtyStart;
+    int m_dirtyEnd;
+
+    // Base path of the note at last update of links.
+    // Links are resolved again once the note is moved.
+    QString m_linkBasePath;
+
+    // Whether to resolve all the links again at next update.
+    bool m_linksInvalidated;
+
+    // Short URLs of links to resolve again at next update, such as those
+    // downloaded.
+    QSet<QString> m_staleUrls;
+
+    // Number of links previewing each image.
+    QHash<QString, int> m_imageRefs;
+
+    // Images being decoded in worker threads and their sizes after decoding.
+    // A placeholder of the size is previewed before the decoding finishes.
+    QHash<QString, QSize> m_pendingImages;
+
+    // Images far away from the viewport whose decoding is deferred.
+    // A placeholder of the size is previewed until it gets near the viewport.
+    QHash<QString, DeferredImage> m_deferredImages;
+
+    // Animated images previewed.
+    QHash<QString, QMovie *> m_animatedImages;
+
+    // Timer to decode deferred images and update animations after scrolling.
+    QTimer *m_decodeTimer;
+};
 #endif // VPREVIEWMANAGER_H
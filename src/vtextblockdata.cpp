@@ -99,3 +99,22 @@ bool VTextBlockData::clearObsoletePreview(long long p_timeStamp, PreviewSource p
 
     return deleted;
 }
+
+bool VTextBlockData::hasSamePreviews(PreviewSource p_source,
+                                     const QVector<VPreviewedImageInfo> &p_images) const
+{
+    int idx = 0;
+    for (auto const ele : m_previews) {
+        if (ele->m_source != p_source) {
+            continue;
+        }
+
+        if (idx >= p_images.size() || !(ele->m_imageInfo == p_images[idx])) {
+            return false;
+        }
+
+        ++idx;
+    }
+
+    return idx == p_images.size();
+}
@@ -144,6 +144,10 @@ public:
 
     const QVector<VPreviewInfo *> &getPreviews() const;
 
+    // Whether the previews from source @p_source are exactly @p_images in order.
+    bool hasSamePreviews(PreviewSource p_source,
+                         const QVector<VPreviewedImageInfo> &p_images) const;
+
     // Return true if there have obsolete preview being deleted.
     bool clearObsoletePreview(long long p_timeStamp, PreviewSource p_source);
 
@@ -22,12 +22,14 @@ VTextDocumentLayout::VTextDocumentLayout(QTextDocument *p_doc,
     : QAbstractTextDocumentLayout(p_doc),
       m_margin(p_doc->documentMargin()),
       m_width(0),
-      m_maximumWidthBlockNumber(-1),
       m_height(0),
       m_lineLeading(0),
       m_blockCount(0),
       m_cursorWidth(1),
       m_cursorMargin(4),
+      m_lazyLayoutBlockThreshold(0),
+      m_estimatedLineHeight(0),
+      m_estimatedCharWidth(0),
       m_imageMgr(p_imageMgr),
       m_blockImageEnabled(false),
       m_imageWidthConstrainted(false),
@@ -64,53 +66,6 @@ static void fillBackground(QPainter *p_painter,
     p_painter->restore();
 }
 
-void VTextDocumentLayout::blockRangeFromRect(const QRectF &p_rect,
-                                             int &p_first,
-                                             int &p_last) const
-{
-    if (p_rect.isNull()) {
-        p_first = 0;
-        p_last = m_blocks.size() - 1;
-        return;
-    }
-
-    p_first = -1;
-    p_last = m_blocks.size() - 1;
-    int y = p_rect.y();
-    Q_ASSERT(document()->blockCount() == m_blocks.size());
-    QTextBlock block = document()->firstBlock();
-    while (block.isValid()) {
-        const BlockInfo &info = m_blocks[block.blockNumber()];
-        Q_ASSERT(info.hasOffset());
-
-        if (info.top() == y
-            || (info.top() < y && info.bottom() >= y)) {
-            p_first = block.blockNumber();
-            break;
-        }
-
-        block = block.next();
-    }
-
-    if (p_first == -1) {
-        p_last = -1;
-        return;
-    }
-
-    y += p_rect.height();
-    while (block.isValid()) {
-        const BlockInfo &info = m_blocks[block.blockNumber()];
-        Q_ASSERT(info.hasOffset());
-
-        if (info.bottom() > y) {
-            p_last = block.blockNumber();
-            break;
-        }
-
-        block = block.next();
-    }
-}
-
 void VTextDocumentLayout::blockRangeFromRectBS(const QRectF &p_rect,
                                                int &p_first,
                                                int &p_last) const
@@ -130,58 +85,31 @@ void VTextDocumentLayout::blockRangeFromRectBS(const QRectF &p_rect,
         return;
     }
 
-    int y = p_rect.bottom();
-    QTextBlock block = document()->findBlockByNumber(p_first);
-
-    if (m_blocks[p_first].top() == p_rect.top()
+    if (blockTop(p_first) == p_rect.top()
         && p_first > 0) {
         --p_first;
     }
 
-    p_last = m_blocks.size() - 1;
-    while (block.isValid()) {
-        const BlockInfo &info = m_blocks[block.blockNumber()];
-        Q_ASSERT(info.hasOffset());
-
-        if (info.bottom() > y) {
-            p_last = block.blockNumber();
-            break;
-        }
-
-        block = block.next();
-    }
+    p_last = findBlockByPosition(p_rect.bottomLeft());
 }
 
 int VTextDocumentLayout::findBlockByPosition(const QPointF &p_point) const
 {
-    int first = 0, last = m_blocks.size() - 1;
-    int y = p_point.y();
-    while (first <= last) {
-        int mid = (first + last) / 2;
-        const BlockInfo &info = m_blocks[mid];
-        Q_ASSERT(info.hasOffset());
-        if (info.top() <= y && info.bottom() > y) {
-            // Found it.
-            return mid;
-        } else if (info.top() > y) {
-            last = mid - 1;
-        } else {
-            first = mid + 1;
-        }
-    }
-
-    int idx = previousValidBlockNumber(m_blocks.size());
-    if (y >= m_blocks[idx].bottom()) {
-        return idx;
+    if (m_blocks.isEmpty()) {
+        return -1;
     }
 
-    idx = nextValidBlockNumber(-1);
-    if (y < m_blocks[idx].top()) {
-        return idx;
+    int y = p_point.y();
+    int idx = m_sizeTree.findByOffset(y);
+    if (idx < 0) {
+        // Above the first block.
+        return 0;
+    } else if (idx >= m_blocks.size()) {
+        // Below the last block.
+        return m_blocks.size() - 1;
     }
 
-    Q_ASSERT(false);
-    return -1;
+    return idx;
 }
 
 void VTextDocumentLayout::draw(QPainter *p_painter, const PaintContext &p_context)
@@ -193,9 +121,22 @@ void VTextDocumentLayout::draw(QPainter *p_painter, const PaintContext &p_contex
         return;
     }
 
+    VImageResourceManager2::beginPaint();
+
+    // Layout the blocks to draw on demand, which may change the block range.
+    bool layouted = false;
+    while (ensureBlockRangeLayout(first, last)) {
+        layouted = true;
+        blockRangeFromRectBS(p_context.clip, first, last);
+    }
+
+    if (layouted) {
+        updateDocumentSize();
+    }
+
     QTextDocument *doc = document();
     Q_ASSERT(doc->blockCount() == m_blocks.size());
-    QPointF offset(m_margin, m_blocks[first].top());
+    QPointF offset(m_margin, blockTop(first));
     QTextBlock block = doc->findBlockByNumber(first);
     QTextBlock lastBlock = doc->findBlockByNumber(last);
 
@@ -204,7 +145,7 @@ void VTextDocumentLayout::draw(QPainter *p_painter, const PaintContext &p_contex
 
     while (block.isValid()) {
         const BlockInfo &info = m_blocks[block.blockNumber()];
-        Q_ASSERT(info.hasOffset());
+        Q_ASSERT(info.hasRect());
 
         const QRectF &rect = info.m_rect;
         QTextLayout *layout = block.layout();
@@ -352,11 +293,18 @@ int VTextDocumentLayout::hitTest(const QPointF &p_point, Qt::HitTestAccuracy p_a
         return -1;
     }
 
+    // Layout the block on demand, which may change the block at @p_point.
+    VTextDocumentLayout *that = const_cast<VTextDocumentLayout *>(this);
+    while (that->ensureBlockLayout(document()->findBlockByNumber(bn))) {
+        that->updateDocumentSize();
+        bn = findBlockByPosition(p_point);
+    }
+
     QTextBlock block = document()->findBlockByNumber(bn);
     Q_ASSERT(block.isValid());
     QTextLayout *layout = block.layout();
     int off = 0;
-    QPointF pos = p_point - QPointF(m_margin, m_blocks[bn].top());
+    QPointF pos = p_point - QPointF(m_margin, blockTop(bn));
     for (int i = 0; i < layout->lineCount(); ++i) {
         QTextLine line = layout->lineAt(i);
         const QRectF lr = line.naturalTextRect();
@@ -397,9 +345,17 @@ QRectF VTextDocumentLayout::blockBoundingRect(const QTextBlock &p_block) const
         return QRectF();
     }
 
-    const BlockInfo &info = m_blocks[p_block.blockNumber()];
-    QRectF geo = info.m_rect.adjusted(0, info.m_offset, 0, info.m_offset);
-    Q_ASSERT(info.hasOffset());
+    // Layout it on demand.
+    VTextDocumentLayout *that = const_cast<VTextDocumentLayout *>(this);
+    if (that->ensureBlockLayout(p_block)) {
+        that->updateDocumentSize();
+    }
+
+    int num = p_block.blockNumber();
+    const BlockInfo &info = m_blocks[num];
+    qreal offset = blockTop(num);
+    QRectF geo = info.m_rect.adjusted(0, offset, 0, offset);
+    Q_ASSERT(info.hasRect());
 
     return geo;
 }
@@ -419,6 +375,7 @@ void VTextDocumentLayout::documentChanged(int p_from, int p_charsRemoved, int p_
     QTextBlock changeEndBlock = doc->findBlock(qMax(0, p_from + charsChanged));
 
     bool needRelayout = false;
+    int nrAffectedBlocks = 0;
     if (changeStartBlock == changeEndBlock
         && newBlockCount == m_blockCount) {
         // Change single block internal only.
@@ -431,17 +388,22 @@ void VTextDocumentLayout::documentChanged(int p_from, int p_charsRemoved, int p_
             // Only one block is affected.
             if (newBr.height() == oldBr.height()) {
                 // Update document size.
-                updateDocumentSizeWithOneBlockChanged(block.blockNumber());
+                updateDocumentSize();
 
                 emit updateBlock(block);
                 return;
             }
         }
     } else {
+        // Shift the infos of the following blocks before clearing the
+        // affected ones, which are indexed by the new block numbers.
+        updateBlockCount(newBlockCount, changeStartBlock.blockNumber());
+
         // Clear layout of all affected blocks.
         QTextBlock block = changeStartBlock;
         do {
             clearBlockLayout(block);
+            ++nrAffectedBlocks;
             if (block == changeEndBlock) {
                 break;
             }
@@ -452,26 +414,36 @@ void VTextDocumentLayout::documentChanged(int p_from, int p_charsRemoved, int p_
         needRelayout = true;
     }
 
-    updateBlockCount(newBlockCount, changeStartBlock.blockNumber());
+    // Estimate the affected blocks instead of layouting them if there are too
+    // many, such as opening a note or resizing the editor.
+    bool lazy = needRelayout
+                && m_lazyLayoutBlockThreshold > 0
+                && nrAffectedBlocks > m_lazyLayoutBlockThreshold;
+    if (lazy) {
+        updateEstimationMetrics();
+    }
 
     if (needRelayout) {
-        // Relayout all affected blocks.
-        QTextBlock block = changeStartBlock;
-        do {
-            layoutBlock(block);
-            if (block == changeEndBlock) {
-                break;
-            }
+        if (lazy) {
+            estimateBlocksLayout(changeStartBlock, changeEndBlock);
+        } else {
+            // Relayout all affected blocks.
+            QTextBlock block = changeStartBlock;
+            do {
+                layoutBlock(block);
+                if (block == changeEndBlock) {
+                    break;
+                }
 
-            block = block.next();
-        } while(block.isValid());
+                block = block.next();
+            } while(block.isValid());
+        }
     }
 
     updateDocumentSize();
 
     // TODO: Update the view of all the blocks after changeStartBlock.
-    const BlockInfo &firstInfo = m_blocks[changeStartBlock.blockNumber()];
-    emit update(QRectF(0., firstInfo.m_offset, 1000000000., 1000000000.));
+    emit update(QRectF(0., blockTop(changeStartBlock.blockNumber()), 1000000000., 1000000000.));
 }
 
 void VTextDocumentLayout::clearBlockLayout(QTextBlock &p_block)
@@ -480,71 +452,121 @@ void VTextDocumentLayout::clearBlockLayout(QTextBlock &p_block)
     int num = p_block.blockNumber();
     if (num < m_blocks.size()) {
         m_blocks[num].reset();
-        clearOffsetFrom(num + 1);
+        setBlockRect(num, QRectF());
     }
 }
 
-void VTextDocumentLayout::clearOffsetFrom(int p_blockNumber)
+void VTextDocumentLayout::setBlockRect(int p_blockNumber, const QRectF &p_rect)
+{
+    BlockInfo &info = m_blocks[p_blockNumber];
+    info.m_rect = p_rect;
+    m_sizeTree.setSize(p_blockNumber, info.height(), info.width());
+}
+
+void VTextDocumentLayout::estimateBlockLayout(QTextBlock &p_block)
+{
+    p_block.clearLayout();
+    int num = p_block.blockNumber();
+    BlockInfo &info = m_blocks[num];
+    info.reset();
+    info.m_estimatedSize = QSizeF(0, estimateBlockHeight(p_block));
+    m_sizeTree.setSize(num, info.height(), info.width());
+}
+
+void VTextDocumentLayout::estimateBlocksLayout(const QTextBlock &p_first,
+                                               const QTextBlock &p_last)
 {
-    for (int i = p_blockNumber; i < m_blocks.size(); ++i) {
-        if (!m_blocks[i].hasOffset()) {
-            Q_ASSERT(validateBlocks());
+    updateEstimationMetrics();
+
+    QTextBlock block = p_first;
+    while (block.isValid()) {
+        estimateBlockLayout(block);
+        if (block == p_last) {
             break;
         }
 
-        m_blocks[i].m_offset = -1;
+        block = block.next();
     }
 }
 
-void VTextDocumentLayout::fillOffsetFrom(int p_blockNumber)
+qreal VTextDocumentLayout::estimateBlockHeight(const QTextBlock &p_block) const
 {
-    qreal offset = m_blocks[p_blockNumber].bottom();
-    for (int i = p_blockNumber + 1; i < m_blocks.size(); ++i) {
-        BlockInfo &info = m_blocks[i];
-        if (!info.m_rect.isNull()) {
-            info.m_offset = offset;
-            offset += info.m_rect.height();
-        } else {
-            break;
-        }
+    int nrLines = 1;
+    qreal availableWidth = document()->pageSize().width();
+    if (availableWidth > 0 && m_estimatedCharWidth > 0) {
+        availableWidth -= (2 * m_margin + m_cursorMargin + m_cursorWidth);
+        int charsPerLine = qMax(1, (int)(availableWidth / m_estimatedCharWidth));
+        nrLines = qMax(1, (p_block.length() - 1 + charsPerLine - 1) / charsPerLine);
+    }
+
+    qreal height = nrLines * m_estimatedLineHeight;
+
+    // Add bottom margin.
+    if (!p_block.next().isValid()) {
+        height += m_margin;
     }
+
+    return height;
 }
 
-bool VTextDocumentLayout::validateBlocks() const
+void VTextDocumentLayout::updateEstimationMetrics()
 {
-    bool valid = true;
-    for (int i = 0; i < m_blocks.size(); ++i) {
-        const BlockInfo &info = m_blocks[i];
-        if (!info.hasOffset()) {
-            valid = false;
-        } else if (!valid) {
-            return false;
-        }
+    QFontMetricsF fm(document()->defaultFont());
+    m_estimatedLineHeight = fm.lineSpacing() + m_lineLeading;
+    m_estimatedCharWidth = fm.averageCharWidth();
+}
+
+bool VTextDocumentLayout::ensureBlockLayout(const QTextBlock &p_block)
+{
+    // m_blocks may be out of date before documentChanged().
+    if (!p_block.isValid() || m_blocks.size() != document()->blockCount()) {
+        return false;
     }
 
+    if (m_blocks[p_block.blockNumber()].hasRect()) {
+        return false;
+    }
+
+    layoutBlock(p_block);
     return true;
 }
 
-void VTextDocumentLayout::updateBlockCount(int p_count, int p_changeStartBlock)
+bool VTextDocumentLayout::ensureBlockRangeLayout(int p_first, int p_last)
 {
-    if (m_blockCount != p_count) {
-        m_blockCount = p_count;
-        m_blocks.resize(m_blockCount);
+    bool layouted = false;
+    QTextBlock block = document()->findBlockByNumber(p_first);
+    while (block.isValid() && block.blockNumber() <= p_last) {
+        if (ensureBlockLayout(block)) {
+            layouted = true;
+        }
 
-        // Fix m_blocks.
-        QTextBlock block = document()->findBlockByNumber(p_changeStartBlock);
-        while (block.isValid()) {
-            BlockInfo &info = m_blocks[block.blockNumber()];
-            info.reset();
+        block = block.next();
+    }
 
-            QRectF br = blockRectFromTextLayout(block);
-            if (!br.isNull()) {
-                info.m_rect = br;
-            }
+    return layouted;
+}
 
-            block = block.next();
-        }
+void VTextDocumentLayout::updateBlockCount(int p_count, int p_changeStartBlock)
+{
+    if (m_blockCount == p_count) {
+        return;
+    }
+
+    // Blocks are inserted or removed right after the start block of the
+    // change, which will be relayouted along with the other changed blocks.
+    // Infos of the blocks after the change are kept and only shifted.
+    int pos = qMin(p_changeStartBlock + 1, m_blockCount);
+    int delta = p_count - m_blockCount;
+    if (delta > 0) {
+        m_blocks.insert(pos, delta, BlockInfo());
+        m_sizeTree.insert(pos, delta);
+    } else {
+        Q_ASSERT(pos - delta <= m_blockCount);
+        m_blocks.remove(pos, -delta);
+        m_sizeTree.remove(pos, -delta);
     }
+
+    m_blockCount = p_count;
 }
 
 void VTextDocumentLayout::layoutBlock(const QTextBlock &p_block)
@@ -553,21 +575,9 @@ void VTextDocumentLayout::layoutBlock(const QTextBlock &p_block)
     Q_ASSERT(m_margin == doc->documentMargin());
 
     QTextLayout *tl = p_block.layout();
-    QTextOption option = doc->defaultTextOption();
-    tl->setTextOption(option);
+    tl->setTextOption(doc->defaultTextOption());
 
-    int extraMargin = 0;
-    if (option.flags() & QTextOption::AddSpaceForLineAndParagraphSeparators) {
-        QFontMetrics fm(p_block.charFormat().font());
-        extraMargin += fm.width(QChar(0x21B5));
-    }
-
-    qreal availableWidth = doc->pageSize().width();
-    if (availableWidth <= 0) {
-        availableWidth = qreal(INT_MAX);
-    }
-
-    availableWidth -= (2 * m_margin + extraMargin + m_cursorMargin + m_cursorWidth);
+    qreal availableWidth = availableLineWidth(p_block);
 
     QVector<Marker> markers;
     QVector<ImagePaintInfo> images;
@@ -582,6 +592,24 @@ void VTextDocumentLayout::layoutBlock(const QTextBlock &p_block)
     finishBlockLayout(p_block, markers, images);
 }
 
+qreal VTextDocumentLayout::availableLineWidth(const QTextBlock &p_block) const
+{
+    QTextDocument *doc = document();
+    int extraMargin = 0;
+    if (doc->defaultTextOption().flags() & QTextOption::AddSpaceForLineAndParagraphSeparators) {
+        QFontMetrics fm(p_block.charFormat().font());
+        extraMargin += fm.width(QChar(0x21B5));
+    }
+
+    qreal availableWidth = doc->pageSize().width();
+    if (availableWidth <= 0) {
+        availableWidth = qreal(INT_MAX);
+    }
+
+    availableWidth -= (2 * m_margin + extraMargin + m_cursorMargin + m_cursorWidth);
+    return availableWidth;
+}
+
 qreal VTextDocumentLayout::layoutLines(const QTextBlock &p_block,
                                        QTextLayout *p_tl,
                                        QVector<Marker> &p_markers,
@@ -689,14 +717,8 @@ void VTextDocumentLayout::finishBlockLayout(const QTextBlock &p_block,
     ImagePaintInfo ipi;
     BlockInfo &info = m_blocks[num];
     info.reset();
-    info.m_rect = blockRectFromTextLayout(p_block, &ipi);
-    Q_ASSERT(!info.m_rect.isNull());
-    int pre = previousValidBlockNumber(num);
-    if (pre == -1) {
-        info.m_offset = 0;
-    } else if (m_blocks[pre].hasOffset()) {
-        info.m_offset = m_blocks[pre].bottom();
-    }
+    setBlockRect(num, blockRectFromTextLayout(p_block, &ipi));
+    Q_ASSERT(info.hasRect());
 
     bool hasImage = false;
     if (ipi.isValid()) {
@@ -721,53 +743,19 @@ void VTextDocumentLayout::finishBlockLayout(const QTextBlock &p_block,
 
         info.m_markers.append(mk);
     }
-
-    if (info.hasOffset()) {
-        fillOffsetFrom(num);
-    }
-}
-
-int VTextDocumentLayout::previousValidBlockNumber(int p_number) const
-{
-    return p_number >= 0 ? p_number - 1 : -1;
-}
-
-int VTextDocumentLayout::nextValidBlockNumber(int p_number) const
-{
-    if (p_number <= -1) {
-        return 0;
-    } else if (p_number >= m_blocks.size() - 1) {
-        return -1;
-    } else {
-        return p_number + 1;
-    }
 }
 
 void VTextDocumentLayout::updateDocumentSize()
 {
-    // The last valid block.
-    int idx = previousValidBlockNumber(m_blocks.size());
-    Q_ASSERT(idx > -1);
-    if (m_blocks[idx].hasOffset()) {
-        int oldHeight = m_height;
-        int oldWidth = m_width;
-
-        m_height = m_blocks[idx].bottom();
-
-        m_width = 0;
-        for (int i = 0; i < m_blocks.size(); ++i) {
-            const BlockInfo &info = m_blocks[i];
-            Q_ASSERT(info.hasOffset());
-            if (m_width < info.m_rect.width()) {
-                m_width = info.m_rect.width();
-                m_maximumWidthBlockNumber = i;
-            }
-        }
+    int oldHeight = m_height;
+    int oldWidth = m_width;
 
-        if (oldHeight != m_height
-            || oldWidth != m_width) {
-            emit documentSizeChanged(documentSize());
-        }
+    m_height = m_sizeTree.totalHeight();
+    m_width = m_sizeTree.maximumWidth();
+
+    if (oldHeight != m_height
+        || oldWidth != m_width) {
+        emit documentSizeChanged(documentSize());
     }
 }
 
@@ -840,20 +828,6 @@ QRectF VTextDocumentLayout::blockRectFromTextLayout(const QTextBlock &p_block,
     return br;
 }
 
-void VTextDocumentLayout::updateDocumentSizeWithOneBlockChanged(int p_blockNumber)
-{
-    const BlockInfo &info = m_blocks[p_blockNumber];
-    qreal width = info.m_rect.width();
-    if (width > m_width) {
-        m_width = width;
-        m_maximumWidthBlockNumber = p_blockNumber;
-        emit documentSizeChanged(documentSize());
-    } else if (width < m_width && p_blockNumber == m_maximumWidthBlockNumber) {
-        // Shrink the longest block.
-        updateDocumentSize();
-    }
-}
-
 void VTextDocumentLayout::setLineLeading(qreal p_leading)
 {
     if (p_leading >= 0) {
@@ -871,6 +845,11 @@ void VTextDocumentLayout::setImageWidthConstrainted(bool p_enabled)
     relayout();
 }
 
+void VTextDocumentLayout::setLazyLayoutBlockThreshold(int p_threshold)
+{
+    m_lazyLayoutBlockThreshold = p_threshold;
+}
+
 void VTextDocumentLayout::setBlockImageEnabled(bool p_enabled)
 {
     if (m_blockImageEnabled == p_enabled) {
@@ -922,16 +901,26 @@ void VTextDocumentLayout::drawImages(QPainter *p_painter,
     }
 
     for (auto const & img : images) {
-        const QPixmap *image = m_imageMgr->findImage(img.m_name);
-        if (!image) {
-            continue;
-        }
-
         QRect targetRect = img.m_rect.adjusted(p_offset.x(),
                                                p_offset.y(),
                                                p_offset.x(),
                                                p_offset.y()).toRect();
 
+        const QPixmap *image = m_imageMgr->fetchImage(img.m_name);
+        if (!image) {
+            QString path = m_imageMgr->takeReloadPath(img.m_name);
+            if (!path.isEmpty()) {
+                emit requestReloadImage(img.m_name, path);
+            }
+
+            // Draw a placeholder for the image being decoded.
+            QPen oldPen = p_painter->pen();
+            p_painter->setPen(QPen(m_imageLineColor, 1, Qt::DashLine));
+            p_painter->drawRect(targetRect.adjusted(0, 0, -1, -1));
+            p_painter->setPen(oldPen);
+            continue;
+        }
+
         p_painter->drawPixmap(targetRect, *image);
     }
 }
@@ -968,16 +957,21 @@ void VTextDocumentLayout::relayout()
     // Update the margin.
     m_margin = doc->documentMargin();
 
-    QTextBlock block = doc->lastBlock();
-    while (block.isValid()) {
-        clearBlockLayout(block);
-        block = block.previous();
-    }
+    if (m_lazyLayoutBlockThreshold > 0 && m_blocks.size() > m_lazyLayoutBlockThreshold) {
+        // Estimate all the blocks and layout them on demand.
+        estimateBlocksLayout(doc->firstBlock(), doc->lastBlock());
+    } else {
+        QTextBlock block = doc->lastBlock();
+        while (block.isValid()) {
+            clearBlockLayout(block);
+            block = block.previous();
+        }
 
-    block = doc->firstBlock();
-    while (block.isValid()) {
-        layoutBlock(block);
-        block = block.next();
+        block = doc->firstBlock();
+        while (block.isValid()) {
+            layoutBlock(block);
+            block = block.next();
+        }
     }
 
     updateDocumentSize();
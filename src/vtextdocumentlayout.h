@@ -5,7 +5,9 @@
 #include <QVector>
 #include <QSize>
 #include <QSet>
+#include <QPair>
 #include "vconstants.h"
+#include "vblocksizetree.h"
 
 class VImageResourceManager2;
 struct VPreviewedImageInfo;
@@ -47,6 +49,10 @@ public:
 
     void setBlockImageEnabled(bool p_enabled);
 
+    // Lay out blocks on demand with estimated heights when more than
+    // @p_threshold blocks need to be laid out at once. 0 to disable.
+    void setLazyLayoutBlockThreshold(int p_threshold);
+
     // Relayout all the blocks.
     void relayout();
 
@@ -74,6 +80,9 @@ signals:
     // Emit to update current cursor block width if m_cursorBlockMode is enabled.
     void cursorBlockWidthUpdated(int p_width);
 
+    // Emit to reload image @p_name from @p_path since it has been evicted.
+    void requestReloadImage(const QString &p_name, const QString &p_path);
+
 protected:
     void documentChanged(int p_from, int p_charsRemoved, int p_charsAdded) Q_DECL_OVERRIDE;
 
@@ -108,32 +117,30 @@ private:
 
         void reset()
         {
-            m_offset = -1;
             m_rect = QRectF();
+            m_estimatedSize = QSizeF();
             m_markers.clear();
             m_images.clear();
         }
 
-        bool hasOffset() const
+        bool hasRect() const
         {
-            return m_offset > -1 && !m_rect.isNull();
+            return !m_rect.isNull();
         }
 
-        qreal top() const
+        // Estimated size is used before this block is layouted.
+        qreal height() const
         {
-            Q_ASSERT(hasOffset());
-            return m_offset;
+            return m_rect.isNull() ? m_estimatedSize.height() : m_rect.height();
         }
 
-        qreal bottom() const
+        qreal width() const
         {
-            Q_ASSERT(hasOffset());
-            return m_offset + m_rect.height();
+            return m_rect.isNull() ? m_estimatedSize.width() : m_rect.width();
         }
 
-        // Y offset of this block.
-        // -1 for invalid.
-        qreal m_offset;
+        // Estimated size of this block which has not been layouted yet.
+        QSizeF m_estimatedSize;
 
         // The bounding rect of this block, including the margins.
         // Null for invalid.
@@ -183,42 +190,63 @@ private:
                                       QVector<QPair<qreal, qreal>> &p_imageRange);
 
     // Clear the layout of @p_block.
-    // Also clear all the offset behind this block.
     void clearBlockLayout(QTextBlock &p_block);
 
-    // Clear the offset of all the blocks from @p_blockNumber.
-    void clearOffsetFrom(int p_blockNumber);
+    // Set the rect of block @p_blockNumber and update m_sizeTree.
+    void setBlockRect(int p_blockNumber, const QRectF &p_rect);
+
+    // Clear the layout of @p_block and estimate its height instead of
+    // layouting it.
+    void estimateBlockLayout(QTextBlock &p_block);
+
+    // Clear the layout of blocks [@p_first, @p_last] and estimate their sizes
+    // instead of layouting them.
+    // Lines are not broken in worker threads: the QTextLayout of a block
+    // belongs to the document and could only be filled in the GUI thread, so
+    // sizes computed on copies would still need the lines broken again here.
+    void estimateBlocksLayout(const QTextBlock &p_first, const QTextBlock &p_last);
+
+    // Width available for the lines of @p_block.
+    qreal availableLineWidth(const QTextBlock &p_block) const;
+
+    // Estimate the height of @p_block from its length and the line metrics.
+    qreal estimateBlockHeight(const QTextBlock &p_block) const;
+
+    // Update the metrics used to estimate block height.
+    void updateEstimationMetrics();
 
-    // Fill the offset filed from @p_blockNumber + 1.
-    void fillOffsetFrom(int p_blockNumber);
+    // Layout @p_block if it has not been layouted yet.
+    // Return true if it is layouted in this call.
+    bool ensureBlockLayout(const QTextBlock &p_block);
+
+    // Layout blocks in [@p_first, @p_last] which have not been layouted yet.
+    // Return true if any block is layouted in this call.
+    bool ensureBlockRangeLayout(int p_first, int p_last);
+
+
+    // Y offset of block @p_blockNumber.
+    qreal blockTop(int p_blockNumber) const;
+
+    qreal blockBottom(int p_blockNumber) const;
 
     // Update block count to @p_count due to document change.
-    // Maintain m_blocks.
+    // Maintain m_blocks and m_sizeTree.
     // @p_changeStartBlock is the block number of the start block in this change.
     void updateBlockCount(int p_count, int p_changeStartBlock);
 
-    bool validateBlocks() const;
-
     void finishBlockLayout(const QTextBlock &p_block,
                            const QVector<Marker> &p_markers,
                            const QVector<ImagePaintInfo> &p_images);
 
-    int previousValidBlockNumber(int p_number) const;
-
-    int nextValidBlockNumber(int p_number) const;
-
     // Update block count and m_blocks size.
     void updateDocumentSize();
 
     QVector<QTextLayout::FormatRange> formatRangeFromSelection(const QTextBlock &p_block,
                                                                const QVector<Selection> &p_selections) const;
 
-    // Get the block range [first, last] by rect @p_rect.
+    // Get the block range [first, last] by rect @p_rect via m_sizeTree.
     // @p_rect: a clip region in document coordinates. If null, returns all the blocks.
     // Return [-1, -1] if no valid block range found.
-    void blockRangeFromRect(const QRectF &p_rect, int &p_first, int &p_last) const;
-
-    // Binary search to get the block range [first, last] by @p_rect.
     void blockRangeFromRectBS(const QRectF &p_rect, int &p_first, int &p_last) const;
 
     // Return a rect from the layout.
@@ -228,10 +256,6 @@ private:
     QRectF blockRectFromTextLayout(const QTextBlock &p_block,
                                    ImagePaintInfo *p_image = NULL);
 
-    // Update document size when only block @p_blockNumber is changed and the height
-    // remain the same.
-    void updateDocumentSizeWithOneBlockChanged(int p_blockNumber);
-
     void adjustImagePaddingAndSize(const VPreviewedImageInfo *p_info,
                                    int p_maximumWidth,
                                    int &p_padding,
@@ -259,9 +283,6 @@ private:
     // Maximum width of the contents.
     qreal m_width;
 
-    // The block number of the block which contains the m_width.
-    int m_maximumWidthBlockNumber;
-
     // Height of all the document (all the blocks).
     qreal m_height;
 
@@ -279,6 +300,20 @@ private:
 
     QVector<BlockInfo> m_blocks;
 
+    // Lay out blocks on demand when more blocks than this need to be laid out
+    // at once. 0 to disable.
+    int m_lazyLayoutBlockThreshold;
+
+    // Height of one line used to estimate block height.
+    qreal m_estimatedLineHeight;
+
+    // Average character width used to estimate block height.
+    qreal m_estimatedCharWidth;
+
+    // Heights and widths of m_blocks to get the offset of a block, the block
+    // at an offset and the widest block in O(log n).
+    VBlockSizeTree m_sizeTree;
+
     VImageResourceManager2 *m_imageMgr;
 
     bool m_blockImageEnabled;
@@ -307,6 +342,16 @@ private:
     int m_cursorLineBlockNumber;
 };
 
+inline qreal VTextDocumentLayout::blockTop(int p_blockNumber) const
+{
+    return m_sizeTree.offset(p_blockNumber);
+}
+
+inline qreal VTextDocumentLayout::blockBottom(int p_blockNumber) const
+{
+    return blockTop(p_blockNumber) + m_blocks[p_blockNumber].height();
+}
+
 inline qreal VTextDocumentLayout::getLineLeading() const
 {
     return m_lineLeading;
@@ -62,6 +62,9 @@ void VTextEdit::init()
 
     docLayout->setVirtualCursorBlockWidth(VIRTUAL_CURSOR_BLOCK_WIDTH);
 
+    connect(docLayout, &VTextDocumentLayout::requestReloadImage,
+            this, &VTextEdit::requestReloadImage);
+
     connect(docLayout, &VTextDocumentLayout::cursorBlockWidthUpdated,
             this, [this](int p_width) {
                 if (p_width != cursorWidth()
@@ -285,6 +288,15 @@ QTextBlock VTextEdit::firstVisibleBlock() const
     return document()->findBlockByNumber(blockNumber);
 }
 
+QTextBlock VTextEdit::lastVisibleBlock() const
+{
+    VTextDocumentLayout *layout = getLayout();
+    Q_ASSERT(layout);
+    int blockNumber = layout->findBlockByPosition(QPointF(0,
+                                                          -contentOffsetY() + viewport()->height()));
+    return document()->findBlockByNumber(blockNumber);
+}
+
 int VTextEdit::contentOffsetY() const
 {
     QScrollBar *sb = verticalScrollBar();
@@ -303,6 +315,14 @@ void VTextEdit::relayout(const QSet<int> &p_blocks)
     getLayout()->relayout(p_blocks);
 }
 
+void VTextEdit::updateBlocks(const QSet<int> &p_blocks)
+{
+    VTextDocumentLayout *layout = getLayout();
+    for (auto bn : p_blocks) {
+        layout->updateBlockByNumber(bn);
+    }
+}
+
 bool VTextEdit::containsImage(const QString &p_imageName) const
 {
     return m_imageMgr->contains(p_imageName);
@@ -310,19 +330,39 @@ bool VTextEdit::containsImage(const QString &p_imageName) const
 
 QSize VTextEdit::imageSize(const QString &p_imageName) const
 {
-    const QPixmap *img = m_imageMgr->findImage(p_imageName);
-    if (img) {
-        return img->size();
-    }
+    return m_imageMgr->imageSize(p_imageName);
+}
 
-    return QSize();
+void VTextEdit::addImage(const QString &p_imageName,
+                         const QPixmap &p_image,
+                         const QString &p_path)
+{
+    if (m_blockImageEnabled) {
+        m_imageMgr->addImage(p_imageName, p_image, p_path);
+    }
 }
 
-void VTextEdit::addImage(const QString &p_imageName, const QPixmap &p_image)
+bool VTextEdit::addSharedImage(const QString &p_imageName,
+                               const QString &p_path,
+                               const QSize &p_size)
 {
     if (m_blockImageEnabled) {
-        m_imageMgr->addImage(p_imageName, p_image);
+        return m_imageMgr->addSharedImage(p_imageName, p_path, p_size);
     }
+
+    return false;
+}
+
+bool VTextEdit::paintImage(const QString &p_imageName,
+                           const QPoint &p_pos,
+                           const QImage &p_tile)
+{
+    return m_imageMgr->paintImage(p_imageName, p_pos, p_tile);
+}
+
+bool VTextEdit::shareImage(const QString &p_imageName, const QString &p_path)
+{
+    return m_imageMgr->shareImage(p_imageName, p_path);
 }
 
 void VTextEdit::removeImage(const QString &p_imageName)
@@ -350,6 +390,11 @@ void VTextEdit::setImageWidthConstrainted(bool p_enabled)
     getLayout()->setImageWidthConstrainted(p_enabled);
 }
 
+void VTextEdit::setLazyLayoutBlockThreshold(int p_threshold)
+{
+    getLayout()->setLazyLayoutBlockThreshold(p_threshold);
+}
+
 void VTextEdit::setImageLineColor(const QColor &p_color)
 {
     getLayout()->setImageLineColor(p_color);
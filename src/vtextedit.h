@@ -3,6 +3,7 @@
 
 #include <QTextEdit>
 #include <QTextBlock>
+#include <QImage>
 
 #include "vlinenumberarea.h"
 #include "vconstants.h"
@@ -35,6 +36,8 @@ public:
 
     QTextBlock firstVisibleBlock() const;
 
+    QTextBlock lastVisibleBlock() const;
+
     void clearBlockImages();
 
     // Whether the resoruce manager contains image of name @p_imageName.
@@ -44,7 +47,26 @@ public:
     QSize imageSize(const QString &p_imageName) const;
 
     // Add an image to the resources.
-    void addImage(const QString &p_imageName, const QPixmap &p_image);
+    // @p_path: the local file or the URL to reload the image from after eviction.
+    void addImage(const QString &p_imageName,
+                  const QPixmap &p_image,
+                  const QString &p_path = QString());
+
+    // Add an image to the resources by sharing the image of local file @p_path
+    // of size @p_size held by any editor.
+    // Return false if there is no such image.
+    bool addSharedImage(const QString &p_imageName,
+                        const QString &p_path,
+                        const QSize &p_size);
+
+    // Paint @p_tile at @p_pos on image @p_imageName in the resources in place.
+    bool paintImage(const QString &p_imageName,
+                    const QPoint &p_pos,
+                    const QImage &p_tile);
+
+    // Share image @p_imageName in the resources as the image of local file
+    // @p_path with other editors.
+    bool shareImage(const QString &p_imageName, const QString &p_path);
 
     // Remove an image from the resources.
     void removeImage(const QString &p_imageName);
@@ -53,10 +75,15 @@ public:
 
     void setImageWidthConstrainted(bool p_enabled);
 
+    void setLazyLayoutBlockThreshold(int p_threshold);
+
     void setImageLineColor(const QColor &p_color);
 
     void relayout(const QSet<int> &p_blocks);
 
+    // Repaint @p_blocks without relayout.
+    void updateBlocks(const QSet<int> &p_blocks);
+
     void setCursorBlockMode(CursorBlock p_mode);
 
     void setHighlightCursorLineBlockEnabled(bool p_enabled);
@@ -65,6 +92,10 @@ public:
 
     void relayout();
 
+signals:
+    // Request to reload image @p_name from @p_path since it has been evicted.
+    void requestReloadImage(const QString &p_name, const QString &p_path);
+
 protected:
     void resizeEvent(QResizeEvent *p_event) Q_DECL_OVERRIDE;
 